@@ -1,12 +1,85 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
 #include "Types.h"
+#include "SourceFile.h"
 #include "Tokenizer.h"
 #include "Compiler.h"
+#include "Benchmark.h"
 
 const std::string gFileName = "code.arhi";
 
+struct CommandLineOptions
+{
+    bool bRunBenchmark = false;
+    bool bDumpTokens = false;
+    // 0 streams the tokens into the compiler, anything else tokenizes the whole file up front on that many threads
+    uint32 job_count = 0;
+    std::string token_dump_file = {};
+    PassOptions pass_options = {};
+};
+
+CommandLineOptions parse_command_line(int argc, char** argv)
+{
+    CommandLineOptions options = {};
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string argument = argv[i];
+
+        if (argument == "--benchmark")
+        {
+            options.bRunBenchmark = true;
+        }
+        else if (argument == "--dump-tokens")
+        {
+            options.bDumpTokens = true;
+        }
+        else if (argument.rfind("--dump-tokens=", 0) == 0)
+        {
+            options.bDumpTokens = true;
+            options.token_dump_file = argument.substr(std::string("--dump-tokens=").length());
+        }
+        else if (argument == "--jobs")
+        {
+            options.job_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        else if (argument.rfind("--jobs=", 0) == 0)
+        {
+            options.job_count = static_cast<uint32>(std::max(1, std::atoi(argument.c_str() + std::string("--jobs=").length())));
+        }
+        else if (argument == "-O0" || argument == "-O1" || argument == "-O2")
+        {
+            options.pass_options.level = static_cast<EOptimizationLevel>(argument[2] - '0');
+        }
+        else if (argument.rfind("--enable-pass=", 0) == 0)
+        {
+            options.pass_options.enabled_passes.push_back(argument.substr(std::string("--enable-pass=").length()));
+        }
+        else if (argument.rfind("--disable-pass=", 0) == 0)
+        {
+            options.pass_options.disabled_passes.push_back(argument.substr(std::string("--disable-pass=").length()));
+        }
+        else if (argument == "--time-passes")
+        {
+            options.pass_options.bTimePasses = true;
+        }
+        else if (argument == "--pass-stats")
+        {
+            options.pass_options.bPrintStatistics = true;
+        }
+        else
+        {
+            std::cerr << "[Warning] Unknown argument '" << argument << "' will be ignored!\n";
+        }
+    }
+
+    return options;
+}
+
 int create_arhi_file()
 {
     std::ifstream exist_code_file = std::ifstream(gFileName);
@@ -33,39 +106,59 @@ int create_arhi_file()
     }
 }
 
-std::string read_file_to_string(const std::string& file_name)
+int main(int argc, char** argv)
 {
-    std::ifstream file = std::ifstream(file_name);
-    if (!file.is_open())
+    const CommandLineOptions options = parse_command_line(argc, argv);
+
+    if (options.bRunBenchmark)
     {
-        std::cerr << "Tokenize error! Could not open " << file_name;
-        return "";
+        arhi::RunClassifierBenchmark(200000);
+        arhi::RunTokenizerBenchmark(500000);
+        return 0;
     }
 
-    std::stringstream buffer = {};
-    buffer << file.rdbuf();
+    if (create_arhi_file() == 1) return 1;
+
+    SourceFile source_file = {};
+    if (!source_file.Open(gFileName)) return 1;
 
-    return buffer.str();
-}
+    Tokenizer tokenizer = Tokenizer(source_file.GetView());
+
+    std::ofstream token_dump_file = {};
+    if (options.bDumpTokens)
+    {
+        if (options.token_dump_file.empty())
+        {
+            tokenizer.EnableTokenTrace(std::cout);
+        }
+        else
+        {
+            token_dump_file.open(options.token_dump_file);
+            if (!token_dump_file.is_open())
+            {
+                std::cerr << "[Error] Could not open the token dump file " << options.token_dump_file << "!\n";
+                return 1;
+            }
+            tokenizer.EnableTokenTrace(token_dump_file);
+        }
+    }
 
-void on_tokenizer_complete(const std::vector<std::vector<Token>>& tokens)
-{
-    std::cout << "Tokenization process complete!" << "\n";
     std::cout << "Compiling started..." << "\n";
 
     Compiler compiler = Compiler();
-    int32 exit_code = compiler.Compile(tokens);
+    compiler.SetPassOptions(options.pass_options);
+    int32 exit_code = 0;
+    if (options.job_count > 0)
+    {
+        tokenizer.TokenizeParallel(options.job_count);
+        exit_code = compiler.Compile(tokenizer.GetTokens(), tokenizer.GetSymbols());
+    }
+    else
+    {
+        exit_code = compiler.Compile(tokenizer);
+    }
 
     std::cout << "Compiling proccess completed with code " << exit_code << "\n";
-}
-
-int main()
-{
-    if (create_arhi_file() == 1) return 1;
-
-    const std::string file_content = read_file_to_string(gFileName);
-    Tokenizer tokenizer = Tokenizer(file_content, &on_tokenizer_complete);
-    tokenizer.Tokenize();
 
     std::cin.get();
 }
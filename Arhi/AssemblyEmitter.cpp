@@ -0,0 +1,14 @@
+#include "AssemblyEmitter.h"
+#include <cstdio>
+
+bool AssemblyEmitter::WriteToFile(const std::string& file_name) const
+{
+    std::FILE* file = std::fopen(file_name.c_str(), "wb");
+    if (!file) return false;
+
+    // Unbuffered, so the whole text reaches the file in a single write
+    std::setvbuf(file, nullptr, _IONBF, 0);
+    const bool bWritten = std::fwrite(m_Buffer.data(), 1, m_Buffer.size(), file) == m_Buffer.size();
+
+    return std::fclose(file) == 0 && bWritten;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Types.h"
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Collects the generated assembly in one growable buffer and writes it out with a single call at the
+// end. Text is appended from views and integers are formatted in place, so emitting an instruction
+// does not allocate once the buffer has grown to the size of the program.
+class AssemblyEmitter
+{
+public:
+	explicit AssemblyEmitter(const size_t initial_capacity = 64 * 1024)
+	{
+		m_Buffer.reserve(initial_capacity);
+	}
+	~AssemblyEmitter() = default;
+
+	AssemblyEmitter& operator<<(std::string_view text)
+	{
+		m_Buffer.append(text);
+		return *this;
+	}
+
+	AssemblyEmitter& operator<<(const char* text)
+	{
+		return *this << std::string_view(text);
+	}
+
+	AssemblyEmitter& operator<<(const std::string& text)
+	{
+		return *this << std::string_view(text);
+	}
+
+	AssemblyEmitter& operator<<(const char character)
+	{
+		m_Buffer.push_back(character);
+		return *this;
+	}
+
+	template <typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+	AssemblyEmitter& operator<<(const T value)
+	{
+		char digits[24] = {};
+		const std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+		m_Buffer.append(digits, result.ptr);
+		return *this;
+	}
+
+	std::string_view GetText() const { return m_Buffer; }
+	size_t GetSize() const { return m_Buffer.size(); }
+	void Clear() { m_Buffer.clear(); }
+
+	// Replaces the file with the buffered text in one write
+	bool WriteToFile(const std::string& file_name) const;
+
+private:
+	std::string m_Buffer = {};
+};
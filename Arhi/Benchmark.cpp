@@ -0,0 +1,132 @@
+#include "Benchmark.h"
+#include "Lexicon.h"
+#include "Tokenizer.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // The classification code the tokenizer used before the lookup tables, kept as the benchmark baseline
+    const std::vector<std::string> legacy_variables = { "bool", "boolean", "byte", "int8", "uint8", "int16", "uint16", "int32", "uint32", "int64", "uint64", "void" };
+    const std::vector<std::string> legacy_operators = { "++", "--", "->", "+", "-", "*", "/", "," };
+    const std::vector<std::string> legacy_keywords = { "global", "local", "if", "define", "return", "true", "false" };
+    const std::vector<std::string> legacy_macros = { "exit!", "negate!", "clamp!", "repeat!", "swap!" };
+
+    bool LegacyIsOperator(const std::string& string_to_check)
+    {
+        for (const std::string& arhioperator : legacy_operators)
+        {
+            if (arhioperator == string_to_check) return true;
+        }
+
+        return false;
+    }
+
+    ETokenType LegacyClassify(const std::string& word)
+    {
+        if (word.length() == 1 && LegacyIsOperator(std::string(1, word[0]))) return ETokenType::Operator;
+        for (const std::string& variable : legacy_variables) if (variable == word) return ETokenType::Variable;
+        for (const std::string& macro : legacy_macros) if (macro == word) return ETokenType::Macro;
+        for (const std::string& keyword : legacy_keywords) if (keyword == word) return ETokenType::Keyword;
+        return ETokenType::Name;
+    }
+
+    ETokenType TableClassify(std::string_view word)
+    {
+        if (word.length() == 1 && arhi::HasCharClass(word[0], arhi::OperatorSymbol)) return ETokenType::Operator;
+        const ETokenType reserved_type = arhi::gIdentifierTable.Find(word);
+        return reserved_type != ETokenType::Unkown ? reserved_type : ETokenType::Name;
+    }
+
+    template <typename ClassifyFunction>
+    double MeasureTokensPerSecond(const std::vector<std::string>& words, const uint32 iterations, ClassifyFunction classify, uint64& checksum)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (uint32 iteration = 0; iteration < iterations; iteration++)
+        {
+            for (const std::string& word : words)
+            {
+                checksum += static_cast<uint64>(classify(word));
+            }
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        return static_cast<double>(words.size()) * iterations / elapsed.count();
+    }
+}
+
+void arhi::RunClassifierBenchmark(const uint32 iterations)
+{
+    // Roughly the mix of a typical Arhi line: types, keywords, user names and single character operators
+    std::vector<std::string> words = {};
+    for (const LexiconEntry& entry : gIdentifierEntries) words.push_back(std::string(entry.word));
+    for (const char* name : { "i", "counter", "result", "equals", "main", "value_1", "x", "y", "accumulator", "temp" })
+    {
+        words.push_back(name);
+        words.push_back(name);
+    }
+    for (const char* symbol : { "+", "-", "*", ",", "(", ")", ";", ":" }) words.push_back(symbol);
+
+    uint64 legacy_checksum = 0;
+    uint64 table_checksum = 0;
+    const double legacy_tokens_per_second = MeasureTokensPerSecond(words, iterations, &LegacyClassify, legacy_checksum);
+    const double table_tokens_per_second = MeasureTokensPerSecond(words, iterations, &TableClassify, table_checksum);
+
+    std::cout << "Classified " << static_cast<uint64>(words.size()) * iterations << " tokens per run\n";
+    std::cout << "Linear scan:  " << static_cast<uint64>(legacy_tokens_per_second) << " tokens/sec\n";
+    std::cout << "Lookup table: " << static_cast<uint64>(table_tokens_per_second) << " tokens/sec\n";
+    std::cout << "Speedup: " << table_tokens_per_second / legacy_tokens_per_second << "x\n";
+
+    if (legacy_checksum != table_checksum)
+    {
+        std::cerr << "[Error] The lookup tables classified tokens differently than the linear scan!\n";
+    }
+}
+
+void arhi::RunTokenizerBenchmark(const uint32 line_count)
+{
+    // Indented statements, long names, literals and comments, repeated until the line count is reached
+    const std::vector<std::string> line_templates = {
+        "define accumulate_values(first_value: int32, second_value: int32) -> int32",
+        "{",
+        "        local intermediate_result: int32 = first_value * 1024 + second_value - 77;",
+        "        local is_greater_than_limit: bool = intermediate_result >= 4096;",
+        "        /* the limit is applied by the clamp macro below, which keeps the value in range */",
+        "        clamp!(intermediate_result, 0, 65535);",
+        "        repeat!(16, { intermediate_result++; });                // keeps the loop tiny",
+        "        return intermediate_result;",
+        "}",
+        ""
+    };
+
+    std::string source_code = {};
+    for (uint32 line = 0; line < line_count; line++)
+    {
+        source_code.append(line_templates[line % line_templates.size()]).append("\n");
+    }
+
+    size_t token_count = 0;
+    Tokenizer tokenizer = Tokenizer(source_code, [&token_count](const TokenStream& tokens) { token_count = tokens.GetTokenCount(); });
+
+    const auto start = std::chrono::steady_clock::now();
+    tokenizer.Tokenize();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "Tokenized " << line_count << " lines (" << source_code.length() << " bytes) into " << token_count << " tokens\n";
+    std::cout << "Tokenizer: " << static_cast<uint64>(token_count / elapsed.count()) << " tokens/sec, "
+        << static_cast<uint64>(source_code.length() / elapsed.count() / (1024.0 * 1024.0)) << " MiB/sec\n";
+
+    const uint32 thread_count = std::max(2u, std::thread::hardware_concurrency());
+    Tokenizer parallel_tokenizer = Tokenizer(source_code, [&token_count](const TokenStream& tokens) { token_count = tokens.GetTokenCount(); });
+
+    const auto parallel_start = std::chrono::steady_clock::now();
+    parallel_tokenizer.TokenizeParallel(thread_count);
+    const std::chrono::duration<double> parallel_elapsed = std::chrono::steady_clock::now() - parallel_start;
+
+    std::cout << "Parallel tokenizer (" << thread_count << " threads): " << static_cast<uint64>(token_count / parallel_elapsed.count()) << " tokens/sec, "
+        << static_cast<uint64>(source_code.length() / parallel_elapsed.count() / (1024.0 * 1024.0)) << " MiB/sec\n";
+}
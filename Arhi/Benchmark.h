@@ -0,0 +1,13 @@
+#pragma once
+
+#include "Types.h"
+
+namespace arhi
+{
+	// Compares the tokenizer's compile-time lookup tables against the linear vector scans they replaced
+	// and prints the classification throughput of both in tokens per second.
+	void RunClassifierBenchmark(const uint32 iterations);
+
+	// Tokenizes a generated source file with the given number of lines and prints the throughput
+	void RunTokenizerBenchmark(const uint32 line_count);
+}
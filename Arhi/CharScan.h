@@ -0,0 +1,148 @@
+#pragma once
+
+#include "Types.h"
+#include "Lexicon.h"
+#include <string_view>
+
+// Vectorized scanning helpers for the tokenizer's hot loops. Each function returns the first index at
+// or after 'index' that ends the run it scans for (or the line length), testing 32 bytes per step with
+// AVX2, 16 with SSE2 and falling back to a scalar loop for the tail and for other targets.
+// They never read past the end of the line, which matters because lines point into a mapped file.
+// Define ARHI_DISABLE_SIMD to force the scalar path.
+#if !defined(ARHI_DISABLE_SIMD)
+#if defined(__AVX2__)
+#define ARHI_SIMD_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ARHI_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace arhi
+{
+	inline uint32 CountTrailingZeros(const uint32 mask)
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		unsigned long index = 0;
+		_BitScanForward(&index, mask);
+		return static_cast<uint32>(index);
+#else
+		return static_cast<uint32>(__builtin_ctz(mask));
+#endif
+	}
+
+#if defined(ARHI_SIMD_AVX2)
+	using SimdVector = __m256i;
+	constexpr size_t SIMD_WIDTH = 32;
+
+	inline SimdVector SimdLoad(const char* data) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data)); }
+	inline SimdVector SimdSet(const char c) { return _mm256_set1_epi8(c); }
+	inline SimdVector SimdEquals(SimdVector a, SimdVector b) { return _mm256_cmpeq_epi8(a, b); }
+	inline SimdVector SimdOr(SimdVector a, SimdVector b) { return _mm256_or_si256(a, b); }
+	inline SimdVector SimdSub(SimdVector a, SimdVector b) { return _mm256_sub_epi8(a, b); }
+	// Unsigned a <= b per byte
+	inline SimdVector SimdLessEqual(SimdVector a, SimdVector b) { return _mm256_cmpeq_epi8(_mm256_max_epu8(a, b), b); }
+	inline uint32 SimdMask(SimdVector a) { return static_cast<uint32>(_mm256_movemask_epi8(a)); }
+	constexpr uint32 SIMD_FULL_MASK = 0xFFFFFFFFu;
+#elif defined(ARHI_SIMD_SSE2)
+	using SimdVector = __m128i;
+	constexpr size_t SIMD_WIDTH = 16;
+
+	inline SimdVector SimdLoad(const char* data) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)); }
+	inline SimdVector SimdSet(const char c) { return _mm_set1_epi8(c); }
+	inline SimdVector SimdEquals(SimdVector a, SimdVector b) { return _mm_cmpeq_epi8(a, b); }
+	inline SimdVector SimdOr(SimdVector a, SimdVector b) { return _mm_or_si128(a, b); }
+	inline SimdVector SimdSub(SimdVector a, SimdVector b) { return _mm_sub_epi8(a, b); }
+	// Unsigned a <= b per byte
+	inline SimdVector SimdLessEqual(SimdVector a, SimdVector b) { return _mm_cmpeq_epi8(_mm_max_epu8(a, b), b); }
+	inline uint32 SimdMask(SimdVector a) { return static_cast<uint32>(_mm_movemask_epi8(a)); }
+	constexpr uint32 SIMD_FULL_MASK = 0xFFFFu;
+#endif
+
+	// Runs the block loop while every byte matches; 'MatchBlock' returns the per byte match mask
+	template <typename MatchBlock, typename MatchByte>
+	inline size_t ScanWhile(std::string_view line, size_t index, MatchBlock match_block, MatchByte match_byte)
+	{
+#if defined(ARHI_SIMD_AVX2) || defined(ARHI_SIMD_SSE2)
+		while (index + SIMD_WIDTH <= line.length())
+		{
+			const uint32 mismatches = ~match_block(SimdLoad(line.data() + index)) & SIMD_FULL_MASK;
+			if (mismatches != 0) return index + CountTrailingZeros(mismatches);
+			index += SIMD_WIDTH;
+		}
+#else
+		(void)match_block;
+#endif
+		while (index < line.length() && match_byte(line[index])) index++;
+		return index;
+	}
+
+	// First index that is not whitespace
+	inline size_t SkipSpaces(std::string_view line, const size_t index)
+	{
+		return ScanWhile(line, index,
+#if defined(ARHI_SIMD_AVX2) || defined(ARHI_SIMD_SSE2)
+			[](SimdVector block)
+			{
+				const SimdVector control_space = SimdLessEqual(SimdSub(block, SimdSet('\t')), SimdSet('\r' - '\t'));
+				return SimdMask(SimdOr(SimdEquals(block, SimdSet(' ')), control_space));
+			},
+#else
+			0,
+#endif
+			[](const char c) { return HasCharClass(c, Space); });
+	}
+
+	// First index that is not a letter, digit or underscore
+	inline size_t SkipIdentifierCharacters(std::string_view line, const size_t index)
+	{
+		return ScanWhile(line, index,
+#if defined(ARHI_SIMD_AVX2) || defined(ARHI_SIMD_SSE2)
+			[](SimdVector block)
+			{
+				const SimdVector lower_case = SimdOr(block, SimdSet(0x20));
+				const SimdVector letter = SimdLessEqual(SimdSub(lower_case, SimdSet('a')), SimdSet('z' - 'a'));
+				const SimdVector digit = SimdLessEqual(SimdSub(block, SimdSet('0')), SimdSet('9' - '0'));
+				return SimdMask(SimdOr(SimdOr(letter, digit), SimdEquals(block, SimdSet('_'))));
+			},
+#else
+			0,
+#endif
+			[](const char c) { return HasCharClass(c, Alpha | Digit) || c == '_'; });
+	}
+
+	// First index that is not a decimal digit
+	inline size_t SkipDigits(std::string_view line, const size_t index)
+	{
+		return ScanWhile(line, index,
+#if defined(ARHI_SIMD_AVX2) || defined(ARHI_SIMD_SSE2)
+			[](SimdVector block)
+			{
+				return SimdMask(SimdLessEqual(SimdSub(block, SimdSet('0')), SimdSet('9' - '0')));
+			},
+#else
+			0,
+#endif
+			[](const char c) { return HasCharClass(c, Digit); });
+	}
+
+	// First '*' or '/', the only characters that can change anything inside a block comment
+	inline size_t FindCommentSymbol(std::string_view line, const size_t index)
+	{
+		return ScanWhile(line, index,
+#if defined(ARHI_SIMD_AVX2) || defined(ARHI_SIMD_SSE2)
+			[](SimdVector block)
+			{
+				return ~SimdMask(SimdOr(SimdEquals(block, SimdSet('*')), SimdEquals(block, SimdSet('/'))));
+			},
+#else
+			0,
+#endif
+			[](const char c) { return c != '*' && c != '/'; });
+	}
+}
@@ -1,10 +1,162 @@
 #include "Compiler.h"
 #include <algorithm>
+#include <charconv>
+#include <cstdint>
 
 const std::string ASSEMBLY_FILE_NAME = "arhi.asm";
+const Variable UNKNOWN_VARIABLE = Variable();
+const Function UNKNOWN_FUNCTION = Function();
 
 namespace arhi
 {
+	constexpr ERegister PARAMETER_REGISTERS[] = { ERegister::Rdi, ERegister::Rsi, ERegister::Rdx, ERegister::Rcx, ERegister::R8, ERegister::R9 };
+	// Intermediate results of an expression, none of them carries parameters or comparison operands
+	constexpr ERegister MATHEMATIC_REGISTERS[] = { ERegister::Rax, ERegister::Rbx, ERegister::R10, ERegister::R11 };
+
+	// Register operand of the given size, or an empty operand for sizes no register has
+	Operand SizedRegister(const ERegister reg, const int32 size)
+	{
+		if (size != 8 && size != 4 && size != 2 && size != 1) return {};
+		return Operand::Register(reg, static_cast<uint8>(size));
+	}
+
+	// Next free register of MATHEMATIC_REGISTERS, marked as busy right away
+	Operand TakeMathematicRegister(RegisterMask& busy_registers, const uint8 size)
+	{
+		for (const ERegister reg : MATHEMATIC_REGISTERS)
+		{
+			if (busy_registers & GetRegisterBit(reg)) continue;
+
+			busy_registers |= GetRegisterBit(reg);
+			return Operand::Register(reg, size);
+		}
+		return {};
+	}
+
+	bool IsPowerOfTwo(const uint64 value)
+	{
+		return value != 0 && (value & (value - 1)) == 0;
+	}
+
+	uint32 FloorLog2(uint64 value)
+	{
+		uint32 log = 0;
+		while (value >>= 1) log++;
+		return log;
+	}
+
+	uint64 GetSizeMask(const uint8 size)
+	{
+		return size >= 8 ? ~0ull : (1ull << (size * 8)) - 1;
+	}
+
+	// x / d == mulhi(x, multiplier) >> shift for 64 bit unsigned x (Hacker's Delight, magicu2). bAdd marks a 65 bit
+	// multiplier whose lowest 64 bits are stored, the dividend is added back to the high half then.
+	struct UnsignedMagic
+	{
+		uint64 multiplier = 0;
+		uint32 shift = 0;
+		bool bAdd = false;
+	};
+
+	UnsignedMagic ComputeUnsignedMagic(const uint64 divisor)
+	{
+		UnsignedMagic magic = UnsignedMagic();
+		uint64 quotient = INT64_MAX / divisor;
+		uint64 remainder = INT64_MAX - quotient * divisor;
+		// 2^(precision - 64), the error 2^precision / d may have
+		uint64 step = 0;
+		uint32 precision = 63;
+		do
+		{
+			precision++;
+			step = precision == 64 ? 1 : step * 2;
+			if (remainder + 1 >= divisor - remainder)
+			{
+				if (quotient >= INT64_MAX) magic.bAdd = true;
+				quotient = 2 * quotient + 1;
+				remainder = 2 * remainder + 1 - divisor;
+			}
+			else
+			{
+				if (quotient >= 1ull << 63) magic.bAdd = true;
+				quotient = 2 * quotient;
+				remainder = 2 * remainder + 1;
+			}
+		} while (precision < 128 && step < divisor - 1 - remainder);
+
+		magic.multiplier = quotient + 1;
+		magic.shift = precision - 64;
+		return magic;
+	}
+
+	// x / d == (mulhi(x, multiplier) >> shift) + 1 for negative x, for 64 bit signed x and 3 <= d < 2^63 (Hacker's Delight,
+	// magic). The high half is that of signed x times the multiplier read as unsigned.
+	struct SignedMagic
+	{
+		uint64 multiplier = 0;
+		uint32 shift = 0;
+	};
+
+	SignedMagic ComputeSignedMagic(const uint64 divisor)
+	{
+		constexpr uint64 TWO_63 = 1ull << 63;
+		const uint64 limit = TWO_63 - 1 - TWO_63 % divisor;
+		uint64 limit_quotient = TWO_63 / limit;
+		uint64 limit_remainder = TWO_63 - limit_quotient * limit;
+		uint64 quotient = TWO_63 / divisor;
+		uint64 remainder = TWO_63 - quotient * divisor;
+		uint32 precision = 63;
+		uint64 delta = 0;
+		do
+		{
+			precision++;
+			limit_quotient *= 2;
+			limit_remainder *= 2;
+			if (limit_remainder >= limit)
+			{
+				limit_quotient++;
+				limit_remainder -= limit;
+			}
+			quotient *= 2;
+			remainder *= 2;
+			if (remainder >= divisor)
+			{
+				quotient++;
+				remainder -= divisor;
+			}
+			delta = divisor - remainder;
+		} while (limit_quotient < delta || (limit_quotient == delta && limit_remainder == 0));
+
+		SignedMagic magic = SignedMagic();
+		magic.multiplier = quotient + 1;
+		magic.shift = precision - 64;
+		return magic;
+	}
+
+	// "name(...)" spanning exactly the tokens from begin to end
+	bool IsCallExpression(const std::vector<Token>& tokens, const size_t begin, const size_t end)
+	{
+		if (end < begin + 3 || tokens[begin].type != ETokenType::Name || tokens[begin + 1].value != "(") return false;
+
+		int32 depth = 0;
+		for (size_t i = begin + 1; i < end; i++)
+		{
+			if (tokens[i].value == "(") depth++;
+			else if (tokens[i].value == ")") depth--;
+
+			if (depth == 0) return i + 1 == end;
+		}
+		return false;
+	}
+
+	// Tokens the copies of a repeat! body may add up to, and how many copies a loop iteration runs at most
+	constexpr size_t UNROLL_TOKEN_BUDGET = 64;
+	constexpr int64 MAX_FULL_UNROLL_COUNT = 16;
+	constexpr int64 MAX_UNROLL_FACTOR = 4;
+	// Loop headers start on a 16 byte fetch block
+	constexpr uint8 LOOP_ALIGNMENT = 16;
+
 	template <typename T>
 	constexpr T clamp(const T& value, const T& low, const T& high) 
 	{
@@ -12,99 +164,213 @@ namespace arhi
 	}
 }
 
-int32 Compiler::Compile(const std::vector<std::vector<Token>>& tokens)
+int32 Compiler::Compile(const TokenStream& tokens, SymbolTable& symbols)
 {
-	std::ofstream assembly_file = std::ofstream(ASSEMBLY_FILE_NAME);
+	m_pSymbols = &symbols;
 
-	if (assembly_file.is_open())
+	// One scratch line is refilled from the flat token buffer, so walking the stream allocates nothing per line
+	size_t line_index = 0;
+	return CompileLines([&tokens, &line_index](std::vector<Token>& token_line)
 	{
-		CreateStandardAssembly(assembly_file);
+		if (line_index >= tokens.GetLineCount()) return false;
 
-		bool bHasExitCode = false;
-		m_CurrentLine = 1;
-		for (const std::vector<Token>& token_line : tokens)
-		{
-			CompileToken(token_line, assembly_file, bHasExitCode);
-			m_CurrentLine++;
+		tokens.GetTokenLine(line_index, token_line);
+		line_index++;
+		return true;
+	});
+}
 
-		}
+int32 Compiler::Compile(Tokenizer& tokenizer)
+{
+	m_pSymbols = &tokenizer.GetSymbols();
 
-		if (!bHasExitCode)
-		{
-			std::cerr << "[Error] Your programm has to use the exit! macro at the end of the programm!\n";
-		}
+	return CompileLines([&tokenizer](std::vector<Token>& token_line)
+	{
+		return tokenizer.NextLine(token_line);
+	});
+}
+
+int32 Compiler::CompileLines(const std::function<bool(std::vector<Token>&)>& next_line)
+{
+	MachineProgram program = MachineProgram();
+
+	// Interning is idempotent, so this id matches the one the tokenizer hands out whenever it reaches 'main'
+	m_MainSymbol = m_pSymbols->Intern("main");
+
+	bool bHasExitCode = false;
+	m_CurrentLine = 1;
+
+	std::vector<Token> token_line = {};
+	while (next_line(token_line))
+	{
+		CompileToken(token_line, program, bHasExitCode);
+		m_CurrentLine++;
+	}
 
-		assembly_file.close();
+	if (!bHasExitCode)
+	{
+		std::cerr << "[Error] Your programm has to use the exit! macro at the end of the programm!\n";
+	}
+
+	PassManager pass_manager = PassManager(m_PassOptions);
+	CreatePasses(pass_manager);
+	pass_manager.Run(program, std::cout);
+
+	AssemblyEmitter emitter = AssemblyEmitter();
+	CreateStandardAssembly(emitter);
+	program.Print(emitter);
+
+	if (!emitter.WriteToFile(ASSEMBLY_FILE_NAME))
+	{
+		std::cerr << "[Error] Could not write " << ASSEMBLY_FILE_NAME << "!\n";
+		return 1;
 	}
 
 	return 0;
 }
 
-void Compiler::CompileToken(const std::vector<Token>& tokens, std::ofstream& output_file, bool& bUseExitCode)
+void Compiler::CreatePasses(PassManager& pass_manager) const
+{
+	pass_manager.AddPass("inline", EOptimizationLevel::O2, [](MachineProgram& program, std::ostream& statistics)
+	{
+		Inliner inliner = Inliner();
+		statistics << "Inliner copied " << inliner.Run(program) << " function calls\n";
+	});
+
+	// Calls that are left in front of a ret become jumps
+	pass_manager.AddPass("tail-calls", EOptimizationLevel::O2, [](MachineProgram& program, std::ostream& statistics)
+	{
+		TailCallOptimizer tail_call_optimizer = TailCallOptimizer();
+		tail_call_optimizer.Run(program);
+		statistics << "Tail call optimizer turned " << tail_call_optimizer.GetTailCallCount() << " calls into jumps and "
+			<< tail_call_optimizer.GetRecursionLoopCount() << " recursive calls into loops\n";
+	});
+
+	// Inlined functions nobody calls anymore go away here, together with the code behind returns and exit!
+	pass_manager.AddPass("dead-code", EOptimizationLevel::O1, [](MachineProgram& program, std::ostream& statistics)
+	{
+		DeadCodeElimination dead_code_elimination = DeadCodeElimination();
+		dead_code_elimination.Run(program);
+		statistics << "Dead code elimination removed " << dead_code_elimination.GetRemovedFunctionCount() << " functions and "
+			<< dead_code_elimination.GetRemovedBlockCount() << " unreachable blocks\n";
+	});
+
+	const PassManager::PassFunction peephole = [](MachineProgram& program, std::ostream& statistics)
+	{
+		PeepholeOptimizer peephole_optimizer = PeepholeOptimizer();
+		statistics << "Peephole optimizer removed " << peephole_optimizer.Run(program) << " instructions\n";
+	};
+	pass_manager.AddPass("peephole", EOptimizationLevel::O1, peephole);
+
+	// Initializers and parameters nothing reads would otherwise take a register each
+	pass_manager.AddPass("dead-stores", EOptimizationLevel::O1, [](MachineProgram& program, std::ostream& statistics)
+	{
+		DeadStoreElimination dead_store_elimination = DeadStoreElimination();
+		dead_store_elimination.Run(program);
+		statistics << "Dead store elimination removed " << dead_store_elimination.GetRemovedStoreCount() << " stores into stack slots\n";
+	});
+
+	pass_manager.AddPass("register-allocation", EOptimizationLevel::O1, [](MachineProgram& program, std::ostream& statistics)
+	{
+		RegisterAllocator register_allocator = RegisterAllocator();
+		register_allocator.Run(program);
+		statistics << "Register allocator kept " << register_allocator.GetPromotedSlotCount() << " of " << register_allocator.GetSlotCount() << " stack slots in registers, "
+			<< register_allocator.GetCoalescedParameterCount() << " parameters stayed in their argument registers\n";
+	});
+
+	// Runs on the allocated registers, so values stay where the allocator put them
+	pass_manager.AddPass("value-numbering", EOptimizationLevel::O2, [](MachineProgram& program, std::ostream& statistics)
+	{
+		ValueNumbering value_numbering = ValueNumbering();
+		value_numbering.Run(program);
+		statistics << "Value numbering replaced " << value_numbering.GetReplacedInstructionCount() << " instructions, removed "
+			<< value_numbering.GetRemovedInstructionCount() << " and decided " << value_numbering.GetFoldedBranchCount() << " branches\n";
+	});
+
+	// Promoted slots turn loads and stores into register copies that can be merged now
+	pass_manager.AddPass("peephole", EOptimizationLevel::O1, peephole);
+
+	pass_manager.AddPass("licm", EOptimizationLevel::O2, [](MachineProgram& program, std::ostream& statistics)
+	{
+		LoopInvariantCodeMotion loop_invariant_code_motion = LoopInvariantCodeMotion();
+		statistics << "Loop invariant code motion hoisted " << loop_invariant_code_motion.Run(program) << " instructions\n";
+	});
+
+	// Stack slots only turn into frame offsets here, the assembly cannot be printed without it
+	pass_manager.AddRequiredPass("frame-lowering", [](MachineProgram& program, std::ostream& statistics)
+	{
+		FrameLowering frame_lowering = FrameLowering();
+		frame_lowering.Run(program);
+		statistics << "Frame lowering shared " << frame_lowering.GetSharedSlotCount() << " stack slots, "
+			<< frame_lowering.GetRedZoneFunctionCount() << " functions use the red zone\n";
+	});
+}
+
+void Compiler::CompileToken(const std::vector<Token>& tokens, MachineProgram& program, bool& bUseExitCode)
 {
 	const size_t length = tokens.size();
 
 	if (tokens[0].type == ETokenType::Macro)
 	{
 		CheckforSymicolon(tokens[length - 1]);
-		HandleMacros(tokens, output_file, bUseExitCode);
+		HandleMacros(tokens, program, bUseExitCode);
 	}
 	else if (tokens[0].type == ETokenType::Scope)
 	{
-		HandleScope(tokens, output_file);
+		HandleScope(tokens, program);
 	}
 	else if (tokens[0].type == ETokenType::Name)
 	{
 		CheckforSymicolon(tokens[length - 1]);
 		if (tokens[1].value == "(")
 		{
-			HandleFunctionCall(tokens, output_file);
+			HandleFunctionCall(tokens, program);
 		}
 		else
 		{
-			HandleVariableChanges(tokens, output_file);
+			HandleVariableChanges(tokens, program);
 		}
 	}
 	else if (tokens[0].type == ETokenType::Keyword) 
 	{
 		if (tokens[0].value == "define")
 		{
-			HandleFunctionDecleration(tokens, output_file);
+			HandleFunctionDecleration(tokens, program);
 		}
 		else if (tokens[0].value == "return")
 		{
 			CheckforSymicolon(tokens[length - 1]);
-			HandleReturnKeyword(tokens, output_file);
+			HandleReturnKeyword(tokens, program);
 		}
 		else if (tokens.size() > 3)
 		{
 			if (tokens[3].type == ETokenType::Variable)
 			{
 				CheckforSymicolon(tokens[length - 1]);
-				HandleVariableDecleration(tokens, output_file);
+				HandleVariableDecleration(tokens, program);
 			}
 		}
 	}
 }
 
-void Compiler::CreateStandardAssembly(std::ofstream& output_file)
+void Compiler::CreateStandardAssembly(AssemblyEmitter& emitter)
 {
-	output_file << "section .data\n";
-	output_file << "section .bss\n";
-	output_file << "section .text\n";
-	output_file << " global _start\n";
+	emitter << "section .data\n";
+	emitter << "section .bss\n";
+	emitter << "section .text\n";
+	emitter << " global _start\n";
 }
 
-void Compiler::CreateStandardExitAssemblyCode(std::ofstream& output_file)
+void Compiler::CreateStandardExitAssemblyCode(MachineProgram& program)
 {
-	output_file << " mov rax, 60\n";
-	output_file << " mov rdi, 0\n";
-	output_file << " syscall";
+	program.Emit(EOpcode::Mov, Operand::Register(ERegister::Rax, 8), Operand::Immediate(60));
+	program.Emit(EOpcode::Mov, Operand::Register(ERegister::Rdi, 8), Operand::Immediate(0));
+	program.Emit(EOpcode::Syscall);
 }
 
-bool Compiler::IsCorrectVariableName(const std::string& variable_name, const std::string& result) const
+bool Compiler::IsCorrectVariableName(std::string_view variable_name, const uint32 symbol) const
 {
-	if (result.empty())
+	if (symbol == INVALID_SYMBOL)
 	{
 		std::cerr << "[Error] There is no variable avaiable called '" << variable_name << "'!\n";
 		return false;
@@ -113,9 +379,9 @@ bool Compiler::IsCorrectVariableName(const std::string& variable_name, const std
 	return true;
 }
 
-bool Compiler::IsCorrectFunctionName(const std::string& function_name, const std::string& result) const
+bool Compiler::IsCorrectFunctionName(std::string_view function_name, const uint32 symbol) const
 {
-	if (result.empty())
+	if (symbol == INVALID_SYMBOL)
 	{
 		std::cerr << "[Error] There is no method/function avaiable called '" << function_name << "'!\n";
 		return false;
@@ -128,14 +394,14 @@ bool Compiler::CheckTypeSize(const Variable& variablea, const Variable& variable
 {
 	if (variablea.type_size != variableb.type_size)
 	{
-		std::cerr << "[Error] The variable '" << variablea.variable_name << "' has to have the same type size as the variable '" << variableb.variable_name << "'! Line " << m_CurrentLine << "\n";
+		std::cerr << "[Error] The variable '" << m_pSymbols->GetName(variablea.symbol) << "' has to have the same type size as the variable '" << m_pSymbols->GetName(variableb.symbol) << "'! Line " << m_CurrentLine << "\n";
 		return false;
 	}
 
 	return true;
 }
 
-std::string Compiler::GetMathematicResultIntoRegister(std::vector<Token> tokens, const int32 register_size, std::ofstream& output_file)
+Operand Compiler::GetMathematicResultIntoRegister(std::vector<Token> tokens, const int32 register_size, MachineProgram& program)
 {
 	int32 necessary_parenthesis_deletions = 0;
 	for (int32 j = 0; j < tokens.size(); j++)
@@ -165,10 +431,60 @@ std::string Compiler::GetMathematicResultIntoRegister(std::vector<Token> tokens,
 	int32 i = 0;
 	const size_t length = tokens.size();
 
-	std::vector<std::string> values = {};
+	std::vector<Operand> values = {};
+	// Operations with an unsigned variable on either side divide and shift unsigned
+	std::vector<bool> unsigned_values = {};
 	std::vector<char> operators = {};
 
-	bool b_first_operation = true;
+	const auto get_register_bits = [](const Operand& value)
+	{
+		return value.IsRegister() ? GetRegisterBit(value.reg) : 0u;
+	};
+	const auto apply_top_operator = [&]()
+	{
+		const Operand second_value = values[values.size() - 1];
+		values.pop_back();
+
+		const Operand first_value = values[values.size() - 1];
+		values.pop_back();
+
+		const bool bUnsigned = unsigned_values[unsigned_values.size() - 1] || unsigned_values[unsigned_values.size() - 2];
+		unsigned_values.resize(unsigned_values.size() - 2);
+		unsigned_values.push_back(bUnsigned);
+
+		char using_operator = operators[operators.size() - 1];
+		operators.pop_back();
+
+		const Operand folded_value = FoldMathematicTask(first_value, second_value, register_size, using_operator, bUnsigned);
+		if (!folded_value.empty())
+		{
+			values.push_back(folded_value);
+			return;
+		}
+
+		// The operation needs up to two registers besides its operands (three for a division into a new register),
+		// older intermediate results go to the stack if it runs out
+		const bool bDivision = using_operator == '/' || using_operator == '%';
+		const int32 required_register_count = bDivision && !first_value.IsRegister() ? 3 : 2;
+		RegisterMask busy_registers = 0;
+		const auto get_free_register_count = [&]()
+		{
+			busy_registers = get_register_bits(first_value) | get_register_bits(second_value);
+			for (const Operand& value : values) busy_registers |= get_register_bits(value);
+			return std::count_if(std::begin(arhi::MATHEMATIC_REGISTERS), std::end(arhi::MATHEMATIC_REGISTERS),
+				[busy_registers](const ERegister reg) { return !(busy_registers & GetRegisterBit(reg)); });
+		};
+		while (get_free_register_count() < required_register_count)
+		{
+			Operand& spilled_value = *std::find_if(values.begin(), values.end(), [](const Operand& value) { return value.IsRegister(); });
+			const Operand stack_slot = Operand::StackSlot(program.CreateStackSlot(spilled_value.size), spilled_value.size);
+			program.Emit(EOpcode::Mov, stack_slot, spilled_value);
+			spilled_value = stack_slot;
+		}
+
+		values.push_back(PerformMathematicTask(first_value, second_value, register_size, using_operator, bUnsigned, busy_registers, program));
+	};
+
 	while (i < length)
 	{
 		if (tokens[i].type == ETokenType::Parenthesis)
@@ -181,17 +497,7 @@ std::string Compiler::GetMathematicResultIntoRegister(std::vector<Token> tokens,
 			{
 				while (!operators.empty() && operators[operators.size() - 1] != '(')
 				{
-					const std::string second_value = values[values.size() - 1];
-					values.pop_back();
-
-					const std::string first_value = values[values.size() - 1];
-					values.pop_back();
-
-					char using_operator = operators[operators.size() - 1];
-					operators.pop_back();
-
-					values.push_back(PerformMathematicTask(first_value, second_value, register_size, using_operator, b_first_operation, output_file));
-					b_first_operation = false;
+					apply_top_operator();
 				}
 				if (!operators.empty())
 				{
@@ -203,7 +509,8 @@ std::string Compiler::GetMathematicResultIntoRegister(std::vector<Token> tokens,
 		{
 			if (tokens[i].type == ETokenType::Numeric)
 			{
-				values.push_back(tokens[i].value);
+				values.push_back(GetNumericOperand(tokens[i]));
+				unsigned_values.push_back(false);
 			}
 			else
 			{
@@ -212,35 +519,27 @@ std::string Compiler::GetMathematicResultIntoRegister(std::vector<Token> tokens,
 					if (tokens[i + 1].value == "(")
 					{
 						std::cerr << "[Error / Warning] You cannot use functions in mathematic operations! Use a temporal variable! Line " << m_CurrentLine << "\n";
-						return "";
+						return {};
 					}
 				}
 
-				const Variable variable_name = GetLocalVariableReference(tokens[i].value);
-				if (!IsCorrectVariableName(tokens[i].value, variable_name.variable_name)) return "";
-				values.push_back(variable_name.variable_assembly_safe + "]");
+				const Variable& variable_name = GetLocalVariableReference(tokens[i].symbol);
+				if (!IsCorrectVariableName(tokens[i].value, variable_name.symbol)) return {};
+				values.push_back(GetVariableOperand(variable_name, variable_name.type_size));
+				unsigned_values.push_back(variable_name.bUnsigned);
 			}
 		}
 		else if (tokens[i].type == ETokenType::Keyword)
 		{
 			std::cerr << "[Error] You cannot use keywords in mathematic operations! Line " << m_CurrentLine << "\n";
-			return "";
+			return {};
 		}
 		else if (tokens[i].type == ETokenType::Operator)
 		{
-			while (!operators.empty() && Precedence(operators[operators.size() - 1]) > Precedence(tokens[i].value[0]))
+			// Operators of the same precedence group from the left: a - b + c is (a - b) + c
+			while (!operators.empty() && Precedence(operators[operators.size() - 1]) >= Precedence(tokens[i].value[0]))
 			{
-				const std::string second_value = values[values.size() - 1];
-				values.pop_back();
-
-				const std::string first_value = values[values.size() - 1];
-				values.pop_back();
-
-				char using_operator = operators[operators.size() - 1];
-				operators.pop_back();
-
-				values.push_back(PerformMathematicTask(first_value, second_value, register_size, using_operator, b_first_operation, output_file));
-				b_first_operation = false;
+				apply_top_operator();
 			}
 			operators.push_back(tokens[i].value[0]);
 		}
@@ -250,199 +549,573 @@ std::string Compiler::GetMathematicResultIntoRegister(std::vector<Token> tokens,
 
 	while (!operators.empty())
 	{
-		const std::string second_value = values[values.size() - 1];
-		values.pop_back();
-
-		const std::string first_value = values[values.size() - 1];
-		values.pop_back();
-
-		char using_operator = operators[operators.size() - 1];
-		operators.pop_back();
+		apply_top_operator();
+	}
 
-		values.push_back(PerformMathematicTask(first_value, second_value, register_size, using_operator, b_first_operation, output_file));
-		b_first_operation = false;
+	const Operand result_register = GetCorrectVariableMathematicsRegisterGrade1(register_size);
+	// A fully folded expression or one that ended in another register still has to end up in the result register
+	if (values.size() == 1 && !values[0].IsRegister())
+	{
+		LoadMathematicValue(program, result_register, values[0]);
+	}
+	else if (values.size() == 1 && values[0] != result_register)
+	{
+		program.Emit(EOpcode::Mov, result_register, values[0]);
 	}
 
-	return GetCorrectVariableMathematicsRegisterGrade1(register_size);
+	return result_register;
 }
 
-std::string Compiler::PerformMathematicTask(const std::string& first_value, const std::string& second_value, const int32 register_size, const char operation, const bool b_first_operation, std::ofstream& output_file)
+Operand Compiler::PerformMathematicTask(const Operand& first_value, const Operand& second_value, const int32 register_size, const char operation, const bool bUnsigned, RegisterMask busy_registers, MachineProgram& program)
 {
-	const std::string register_first_grade = GetCorrectVariableMathematicsRegisterGrade1(register_size);
-	const std::string register_second_grade = GetCorrectVariableMathematicsRegisterGrade2(register_size);
-	const std::string register_third_grade = GetCorrectVariableMathematicsRegisterGrade3(register_size);
+	const uint8 size = static_cast<uint8>(register_size);
+	const auto take_register = [&busy_registers, size]()
+	{
+		return arhi::TakeMathematicRegister(busy_registers, size);
+	};
 
-	if (b_first_operation)
+	// The result goes into the register of an intermediate operand, the other operand is used directly where x86 allows it
+	Operand target = {};
+	Operand source = second_value;
+	if (first_value.IsRegister())
 	{
-		output_file << " mov " << register_first_grade << ", " << first_value << "\n";
-		output_file << " mov " << register_second_grade  << ", " << second_value << "\n";
+		target = first_value;
+	}
+	else if (second_value.IsRegister() && (operation == '+' || operation == '*'))
+	{
+		target = second_value;
+		source = first_value;
 	}
 	else
 	{
-		if (first_value == register_first_grade || first_value == register_second_grade || first_value == register_third_grade)
+		target = take_register();
+		LoadMathematicValue(program, target, first_value);
+	}
+
+	if (operation == '/' || operation == '%')
+	{
+		return PerformDivision(target, source, size, operation == '%', bUnsigned, busy_registers, program);
+	}
+
+	// There is no two operand 8 bit imul, the low byte of a 32 bit product is the same
+	const bool bByteMultiplication = operation == '*' && size == 1;
+	if (source.IsImmediate())
+	{
+		const int64 value = arhi::TruncateToSize(source.value, size);
+		// Multiplying by a power of two is a shift, by a negative one a shift and a negation
+		const uint64 magnitude = value < 0 ? 0 - static_cast<uint64>(value) : static_cast<uint64>(value);
+		if (operation == '*' && magnitude > 1 && arhi::IsPowerOfTwo(magnitude))
+		{
+			program.Emit(EOpcode::Shl, target, Operand::Immediate(arhi::FloorLog2(magnitude)));
+			if (value < 0) program.Emit(EOpcode::Neg, target);
+			return target;
+		}
+		if ((operation == '+' || operation == '-') && (value == 1 || value == -1))
+		{
+			const bool bIncrement = (operation == '+') == (value == 1);
+			program.Emit(bIncrement ? EOpcode::Inc : EOpcode::Dec, target);
+			return target;
+		}
+		if (operation == '*' && value == -1)
+		{
+			program.Emit(EOpcode::Neg, target);
+			return target;
+		}
+
+		source = Operand::Immediate(value);
+		if (value < INT32_MIN || value > INT32_MAX)
 		{
-			output_file << " mov " << register_second_grade << ", " << second_value << "\n";
+			source = take_register();
+			program.Emit(EOpcode::Mov, source, Operand::Immediate(value));
+		}
+	}
+	else if (source.IsMemory())
+	{
+		// Wider variables are read through their low part, narrower ones have to be extended first
+		if (source.size >= size && !bByteMultiplication)
+		{
+			source = source.WithSize(size, false);
 		}
 		else
 		{
-			output_file << " mov " << register_second_grade << ", " << first_value << "\n";
+			const Operand extended_value = take_register();
+			LoadMathematicValue(program, extended_value, source);
+			source = extended_value;
 		}
 	}
 
 	if (operation == '+')
 	{
-		output_file << " add " << register_first_grade << ", " << register_second_grade << "\n";
+		program.Emit(EOpcode::Add, target, source);
 	}
 	else if (operation == '-')
 	{
-		output_file << " sub " << register_first_grade << ", " << register_second_grade << "\n";
+		program.Emit(EOpcode::Sub, target, source);
 	}
 	else if (operation == '*')
 	{
-		if (register_size == 1)
+		if (bByteMultiplication)
 		{
-			output_file << " mul " << register_second_grade << "\n";
+			program.Emit(EOpcode::Imul, target.WithSize(4, false), source.IsRegister() ? source.WithSize(4, false) : source);
 		}
 		else
 		{
-			output_file << " imul " << register_first_grade << ", " << register_second_grade << "\n";
+			program.Emit(EOpcode::Imul, target, source);
 		}
 	}
 
-	return register_first_grade;
+	return target;
 }
 
-int32 Compiler::Precedence(char op)
+Operand Compiler::PerformDivision(const Operand& dividend, const Operand& divisor, const uint8 size, const bool bModulo, const bool bUnsigned, RegisterMask busy_registers, MachineProgram& program)
 {
-	if (op == '+' || op == '-') return 1;
-	else if (op == '*' || op == '/') return 2;
-	return 0;
-}
+	if (divisor.IsImmediate())
+	{
+		const int64 value = arhi::TruncateToSize(divisor.value, size);
+		if (value == 0)
+		{
+			std::cerr << "[Error] Division by zero! Line " << m_CurrentLine << "\n";
+			return dividend;
+		}
 
-int32 Compiler::GetVariableSize(const std::string& variable_type) const
-{
-	if (variable_type == "int64" || variable_type == "uint64") return 8;
-	else if (variable_type == "int32" || variable_type == "uint32") return 4;
-	else if (variable_type == "int16" || variable_type == "uint16") return 2;
-	else if (variable_type == "int8" || variable_type == "uint8" || variable_type == "byte" 
-		|| variable_type == "bool" || variable_type == "boolean") return 1;
-	else if (variable_type == "void") return 0;
+		const Operand result = DivideByConstant(dividend, value, size, bModulo, bUnsigned, busy_registers, program);
+		if (!result.empty()) return result;
+	}
+
+	// div and idiv divide rdx:rax, 8 and 16 bit values are divided as 32 bit ones so the remainder is not in ah
+	const uint8 work_size = std::max<uint8>(size, 4);
+	const Operand rax = Operand::Register(ERegister::Rax, work_size);
+	const Operand rdx = Operand::Register(ERegister::Rdx, work_size);
+	const auto extend_value = [&](const Operand& destination, const Operand& value)
+	{
+		if (size < 4) program.Emit(bUnsigned ? EOpcode::Movzx : EOpcode::Movsx, destination, value.WithSize(size, value.IsMemory()));
+		else if (destination != value) program.Emit(EOpcode::Mov, destination, value.WithSize(size, false));
+	};
+
+	// rax may hold another intermediate result
+	const bool bDivisorInRax = divisor.IsRegister() && divisor.reg == ERegister::Rax;
+	const bool bSavesRax = (busy_registers & GetRegisterBit(ERegister::Rax)) && dividend.reg != ERegister::Rax && !bDivisorInRax;
+	busy_registers |= GetRegisterBit(ERegister::Rax);
+
+	Operand divisor_operand = divisor.WithSize(work_size, divisor.IsMemory());
+	if (divisor.IsImmediate())
+	{
+		const int64 value = bUnsigned ? static_cast<int64>(static_cast<uint64>(divisor.value) & arhi::GetSizeMask(size)) : arhi::TruncateToSize(divisor.value, size);
+		divisor_operand = arhi::TakeMathematicRegister(busy_registers, work_size);
+		program.Emit(EOpcode::Mov, divisor_operand, Operand::Immediate(value));
+	}
+	else if ((divisor.IsRegister() && (bDivisorInRax || size < 4)) || (divisor.IsMemory() && (size < 4 || divisor.size < size)))
+	{
+		divisor_operand = arhi::TakeMathematicRegister(busy_registers, work_size);
+		if (divisor.IsMemory() && divisor.size < size) LoadMathematicValue(program, divisor_operand, divisor);
+		else extend_value(divisor_operand, divisor);
+	}
+
+	// Argument registers that are already set must survive a division in the next argument
+	Operand saved_rax = {};
+	Operand saved_rdx = {};
+	if (bSavesRax)
+	{
+		saved_rax = Operand::StackSlot(program.CreateStackSlot(8), 8);
+		program.Emit(EOpcode::Mov, saved_rax, Operand::Register(ERegister::Rax, 8));
+	}
+	if (m_LiveArgumentRegisters & GetRegisterBit(ERegister::Rdx))
+	{
+		saved_rdx = Operand::StackSlot(program.CreateStackSlot(8), 8);
+		program.Emit(EOpcode::Mov, saved_rdx, Operand::Register(ERegister::Rdx, 8));
+	}
+
+	extend_value(rax, dividend);
+	if (bUnsigned) program.Emit(EOpcode::Mov, Operand::Register(ERegister::Rdx, 4), Operand::Immediate(0));
+	else program.Emit(work_size == 8 ? EOpcode::Cqo : EOpcode::Cdq);
+	program.Emit(bUnsigned ? EOpcode::Div : EOpcode::Idiv, divisor_operand);
+
+	const Operand result = bSavesRax ? dividend.WithSize(work_size, false) : rax;
+	if (bModulo || result != rax) program.Emit(EOpcode::Mov, result, bModulo ? rdx : rax);
+
+	if (!saved_rdx.empty()) program.Emit(EOpcode::Mov, Operand::Register(ERegister::Rdx, 8), saved_rdx);
+	if (!saved_rax.empty()) program.Emit(EOpcode::Mov, Operand::Register(ERegister::Rax, 8), saved_rax);
+
+	return result.WithSize(size, false);
 }
 
-Variable Compiler::GetLocalVariableReference(const std::string variable_name) const
+Operand Compiler::DivideByConstant(const Operand& dividend, const int64 divisor, const uint8 size, const bool bModulo, const bool bUnsigned, RegisterMask& busy_registers, MachineProgram& program)
 {
-	for (const std::vector<Variable>& variable_reference_list : m_LocalVariables)
+	const uint32 bit_count = size * 8u;
+	const uint64 magnitude = bUnsigned ? static_cast<uint64>(divisor) & arhi::GetSizeMask(size)
+		: divisor < 0 ? 0 - static_cast<uint64>(divisor) : static_cast<uint64>(divisor);
+
+	if (!bUnsigned && divisor == -1)
+	{
+		if (bModulo) program.Emit(EOpcode::Mov, dividend, Operand::Immediate(0));
+		else program.Emit(EOpcode::Neg, dividend);
+		return dividend;
+	}
+
+	if (arhi::IsPowerOfTwo(magnitude))
 	{
-		for (const Variable& variable_reference : variable_reference_list)
+		const uint32 shift = arhi::FloorLog2(magnitude);
+		if (bUnsigned)
 		{
-			if (variable_reference.variable_name == variable_name)
+			if (!bModulo)
 			{
-				return variable_reference;
+				if (shift > 0) program.Emit(EOpcode::Shr, dividend, Operand::Immediate(shift));
+				return dividend;
 			}
+			if (shift > 31) return {};
+
+			program.Emit(EOpcode::And, dividend, Operand::Immediate(static_cast<int64>(magnitude - 1)));
+			return dividend;
 		}
+
+		// Signed division rounds toward zero: negative dividends get divisor - 1 added before the arithmetic shift
+		if (shift == 0 || shift == bit_count - 1 || (bModulo && shift > 31)) return {};
+
+		const Operand biased = arhi::TakeMathematicRegister(busy_registers, size);
+		program.Emit(EOpcode::Mov, biased, dividend);
+		if (shift > 1) program.Emit(EOpcode::Sar, biased, Operand::Immediate(bit_count - 1));
+		program.Emit(EOpcode::Shr, biased, Operand::Immediate(bit_count - shift));
+		program.Emit(EOpcode::Add, biased, dividend);
+		if (!bModulo)
+		{
+			program.Emit(EOpcode::Sar, biased, Operand::Immediate(shift));
+			if (divisor < 0) program.Emit(EOpcode::Neg, biased);
+			return biased;
+		}
+
+		program.Emit(EOpcode::And, biased, Operand::Immediate(-static_cast<int64>(magnitude)));
+		program.Emit(EOpcode::Sub, dividend, biased);
+		return dividend;
 	}
 
-	return Variable();
-}
+	// Up to 32 bit the dividend is widened to 64 bits, so the product with the magic number can not overflow and no
+	// high multiplication through rdx:rax is needed. 64 bit dividends and divisors above 2^31 need that one.
+	const uint32 divisor_bits = arhi::FloorLog2(magnitude) + 1;
+	if (size == 8 || divisor_bits >= 32) return DivideByConstant64(dividend, divisor, magnitude, size, bModulo, bUnsigned, busy_registers, program);
 
-Function Compiler::GetFunction(const std::string& function_name) const
-{
-	for (const Function& function : m_Functions)
+	const Operand dividend_64 = dividend.WithSize(8, false);
+	const Operand quotient = arhi::TakeMathematicRegister(busy_registers, 8);
+	const Operand scratch = arhi::TakeMathematicRegister(busy_registers, 8);
+	const auto multiply = [&](const uint64 factor)
+	{
+		if (factor <= INT32_MAX)
+		{
+			program.Emit(EOpcode::Imul, quotient, Operand::Immediate(static_cast<int64>(factor)));
+			return;
+		}
+		program.Emit(EOpcode::Mov, scratch, Operand::Immediate(static_cast<int64>(factor)));
+		program.Emit(EOpcode::Imul, quotient, scratch);
+	};
+
+	if (bUnsigned)
 	{
-		if (function.function_name.empty()) continue;
-		if (function.function_name == function_name)
+		if (size == 4) program.Emit(EOpcode::Mov, dividend.WithSize(4, false), dividend.WithSize(4, false));
+		else program.Emit(EOpcode::Movzx, dividend.WithSize(4, false), dividend);
+
+		// x / d == x * m >> (32 + bits) with m = 2^(32 + bits) / d + 1, a 33 bit m is applied as x + (x * (m - 2^32) >> 32)
+		const uint32 shift = 32 + divisor_bits;
+		const uint64 multiplier = (1ull << shift) / magnitude + 1;
+		program.Emit(EOpcode::Mov, quotient, dividend_64);
+		if (multiplier < (1ull << 32))
+		{
+			multiply(multiplier);
+			program.Emit(EOpcode::Shr, quotient, Operand::Immediate(shift));
+		}
+		else
 		{
-			return function;
+			multiply(multiplier - (1ull << 32));
+			program.Emit(EOpcode::Shr, quotient, Operand::Immediate(32));
+			program.Emit(EOpcode::Add, quotient, dividend_64);
+			program.Emit(EOpcode::Shr, quotient, Operand::Immediate(divisor_bits));
 		}
 	}
+	else
+	{
+		program.Emit(size == 4 ? EOpcode::Movsxd : EOpcode::Movsx, dividend_64, dividend);
+
+		// x / d == (x * m >> (31 + bits)) + 1 for negative x, with m = 2^(31 + bits) / d + 1 below 2^32
+		const uint32 shift = 31 + divisor_bits;
+		const uint64 multiplier = (1ull << shift) / magnitude + 1;
+		program.Emit(EOpcode::Mov, quotient, dividend_64);
+		multiply(multiplier);
+		program.Emit(EOpcode::Sar, quotient, Operand::Immediate(shift));
+		program.Emit(EOpcode::Mov, scratch, dividend_64);
+		program.Emit(EOpcode::Shr, scratch, Operand::Immediate(63));
+		program.Emit(EOpcode::Add, quotient, scratch);
+		if (divisor < 0 && !bModulo) program.Emit(EOpcode::Neg, quotient);
+	}
+
+	if (!bModulo) return quotient.WithSize(size, false);
 
-	return Function();
+	// The remainder has the sign of the dividend, so the magnitude of the divisor gives the right product
+	program.Emit(EOpcode::Imul, quotient, Operand::Immediate(static_cast<int64>(magnitude)));
+	program.Emit(EOpcode::Sub, dividend_64, quotient);
+	return dividend;
 }
 
-std::string Compiler::GetCorrectVariableMathematicsRegisterGrade1(int32 variable_size) const
+Operand Compiler::DivideByConstant64(const Operand& dividend, const int64 divisor, const uint64 magnitude, const uint8 size, const bool bModulo, const bool bUnsigned, RegisterMask& busy_registers, MachineProgram& program)
 {
-	switch (variable_size)
+	const Operand rax = Operand::Register(ERegister::Rax, 8);
+	const Operand rdx = Operand::Register(ERegister::Rdx, 8);
+
+	// mul overwrites rax, so a dividend in rax is copied out first. The multiplier only needs a register of its own
+	// when the signed correction reads it again.
+	RegisterMask taken_registers = busy_registers | GetRegisterBit(ERegister::Rax);
+	const Operand value = dividend.reg == ERegister::Rax ? arhi::TakeMathematicRegister(taken_registers, 8) : dividend.WithSize(8, false);
+	const Operand multiplier = bUnsigned ? rax : arhi::TakeMathematicRegister(taken_registers, 8);
+	if (value.empty() || multiplier.empty()) return {};
+
+	// Argument registers that are already set must survive a division in the next argument, like around div
+	const bool bSavesRax = (busy_registers & GetRegisterBit(ERegister::Rax)) && dividend.reg != ERegister::Rax;
+	busy_registers = taken_registers;
+	Operand saved_rax = {};
+	Operand saved_rdx = {};
+	if (bSavesRax)
 	{
-		case 8: return "rax";
-		case 4: return "eax";
-		case 2: return "ax";
-		case 1: return "al";
-		default: return "";
+		saved_rax = Operand::StackSlot(program.CreateStackSlot(8), 8);
+		program.Emit(EOpcode::Mov, saved_rax, rax);
+	}
+	if (m_LiveArgumentRegisters & GetRegisterBit(ERegister::Rdx))
+	{
+		saved_rdx = Operand::StackSlot(program.CreateStackSlot(8), 8);
+		program.Emit(EOpcode::Mov, saved_rdx, rdx);
 	}
-}
 
-std::string Compiler::GetCorrectVariableMathematicsRegisterGrade2(int32 variable_size) const
-{
-	switch (variable_size)
+	// Only unsigned 32 bit dividends come here with their divisor above 2^31, a 32 bit mov clears the upper half
+	if (size < 8) program.Emit(EOpcode::Mov, dividend.WithSize(4, false), dividend.WithSize(4, false));
+	if (value.reg != dividend.reg) program.Emit(EOpcode::Mov, value, rax);
+
+	if (bUnsigned)
+	{
+		const arhi::UnsignedMagic magic = arhi::ComputeUnsignedMagic(magnitude);
+		program.Emit(EOpcode::Mov, rax, Operand::Immediate(static_cast<int64>(magic.multiplier)));
+		program.Emit(EOpcode::Mul, value);
+		if (!magic.bAdd)
+		{
+			if (magic.shift > 0) program.Emit(EOpcode::Shr, rdx, Operand::Immediate(magic.shift));
+		}
+		else
+		{
+			// (x + high) >> shift without losing the carry of the 65 bit sum
+			program.Emit(EOpcode::Mov, rax, value);
+			program.Emit(EOpcode::Sub, rax, rdx);
+			program.Emit(EOpcode::Shr, rax, Operand::Immediate(1));
+			program.Emit(EOpcode::Add, rdx, rax);
+			if (magic.shift > 1) program.Emit(EOpcode::Shr, rdx, Operand::Immediate(magic.shift - 1));
+		}
+	}
+	else
 	{
-		case 8: return "rbx";
-		case 4: return "ebx";
-		case 2: return "bx";
-		case 1: return "bl";
-		default: return "";
+		// mul gives the high half of x as unsigned, a negative x has to take the multiplier off it again. The
+		// sign mask in rax (0 or -1) does that and then rounds negative quotients toward zero.
+		const arhi::SignedMagic magic = arhi::ComputeSignedMagic(magnitude);
+		program.Emit(EOpcode::Mov, multiplier, Operand::Immediate(static_cast<int64>(magic.multiplier)));
+		program.Emit(EOpcode::Mov, rax, value);
+		program.Emit(EOpcode::Mul, multiplier);
+		program.Emit(EOpcode::Mov, rax, value);
+		program.Emit(EOpcode::Sar, rax, Operand::Immediate(63));
+		program.Emit(EOpcode::And, multiplier, rax);
+		program.Emit(EOpcode::Sub, rdx, multiplier);
+		if (magic.shift > 0) program.Emit(EOpcode::Sar, rdx, Operand::Immediate(magic.shift));
+		program.Emit(EOpcode::Sub, rdx, rax);
+		if (divisor < 0 && !bModulo) program.Emit(EOpcode::Neg, rdx);
 	}
-}
 
-std::string Compiler::GetCorrectVariableMathematicsRegisterGrade3(int32 variable_size) const
-{
-	switch (variable_size)
+	if (!bModulo)
+	{
+		program.Emit(EOpcode::Mov, value, rdx);
+	}
+	else
 	{
-		case 8: return "rcx";
-		case 4: return "ecx";
-		case 2: return "cx";
-		case 1: return "cl";
-		default: return "";
+		// The remainder has the sign of the dividend, so the magnitude of the divisor gives the right product
+		if (magnitude <= INT32_MAX)
+		{
+			program.Emit(EOpcode::Imul, rdx, Operand::Immediate(static_cast<int64>(magnitude)));
+		}
+		else
+		{
+			program.Emit(EOpcode::Mov, rax, Operand::Immediate(static_cast<int64>(magnitude)));
+			program.Emit(EOpcode::Imul, rdx, rax);
+		}
+		program.Emit(EOpcode::Sub, value, rdx);
 	}
+
+	if (!saved_rdx.empty()) program.Emit(EOpcode::Mov, rdx, saved_rdx);
+	if (!saved_rax.empty()) program.Emit(EOpcode::Mov, rax, saved_rax);
+
+	return value.WithSize(size, false);
 }
 
-std::string Compiler::GetCorrectVariableMathematicsRegisterGrade4(int32 variable_size) const
+Operand Compiler::FoldMathematicTask(const Operand& first_value, const Operand& second_value, const int32 register_size, const char operation, const bool bUnsigned) const
 {
-	switch (variable_size)
+	const uint8 size = static_cast<uint8>(register_size);
+	const bool bFirstIsNumber = first_value.IsImmediate();
+	const bool bSecondIsNumber = second_value.IsImmediate();
+
+	if (bFirstIsNumber && bSecondIsNumber)
 	{
-		case 8: return "rdx";
-		case 4: return "edx";
-		case 2: return "dx";
-		case 1: return "dl";
-		default: return "";
+		// Wraps around like the register the operation would have run in
+		const uint64 first = static_cast<uint64>(first_value.value);
+		const uint64 second = static_cast<uint64>(second_value.value);
+		if (operation == '+') return Operand::Immediate(arhi::TruncateToSize(static_cast<int64>(first + second), size));
+		if (operation == '-') return Operand::Immediate(arhi::TruncateToSize(static_cast<int64>(first - second), size));
+		if (operation == '*') return Operand::Immediate(arhi::TruncateToSize(static_cast<int64>(first * second), size));
+
+		// Division by zero is reported when the division is emitted
+		if ((operation != '/' && operation != '%') || arhi::TruncateToSize(second_value.value, size) == 0) return {};
+		if (bUnsigned)
+		{
+			const uint64 mask = arhi::GetSizeMask(size);
+			const uint64 result = operation == '/' ? (first & mask) / (second & mask) : (first & mask) % (second & mask);
+			return Operand::Immediate(arhi::TruncateToSize(static_cast<int64>(result), size));
+		}
+
+		// The smallest value divided by -1 overflows, it wraps around to itself like the negation does
+		const int64 dividend = arhi::TruncateToSize(first_value.value, size);
+		const int64 divisor = arhi::TruncateToSize(second_value.value, size);
+		if (divisor == -1) return Operand::Immediate(operation == '/' ? arhi::TruncateToSize(static_cast<int64>(0 - static_cast<uint64>(dividend)), size) : 0);
+		return Operand::Immediate(arhi::TruncateToSize(operation == '/' ? dividend / divisor : dividend % divisor, size));
 	}
+
+	if (operation == '+')
+	{
+		if (bSecondIsNumber && second_value.value == 0) return first_value;
+		if (bFirstIsNumber && first_value.value == 0) return second_value;
+	}
+	else if (operation == '-')
+	{
+		if (bSecondIsNumber && second_value.value == 0) return first_value;
+	}
+	else if (operation == '*')
+	{
+		if (bSecondIsNumber && second_value.value == 1) return first_value;
+		if (bFirstIsNumber && first_value.value == 1) return second_value;
+		if ((bSecondIsNumber && second_value.value == 0) || (bFirstIsNumber && first_value.value == 0)) return Operand::Immediate(0);
+	}
+	else if (operation == '/')
+	{
+		if (bSecondIsNumber && arhi::TruncateToSize(second_value.value, size) == 1) return first_value;
+	}
+	else if (operation == '%')
+	{
+		const int64 divisor = bSecondIsNumber ? arhi::TruncateToSize(second_value.value, size) : 0;
+		if (divisor == 1 || (divisor == -1 && !bUnsigned)) return Operand::Immediate(0);
+	}
+
+	return {};
+}
+
+void Compiler::LoadMathematicValue(MachineProgram& program, const Operand& destination, const Operand& value)
+{
+	// Variables keep their own size and get widened or truncated to the size of the expression
+	Move(program, destination, value, destination.size, value.IsMemory() ? value.size : destination.size);
+}
+
+int32 Compiler::Precedence(char op)
+{
+	if (op == '+' || op == '-') return 1;
+	else if (op == '*' || op == '/' || op == '%') return 2;
+	return 0;
+}
+
+int32 Compiler::GetVariableSize(std::string_view variable_type) const
+{
+	if (variable_type == "int64" || variable_type == "uint64") return 8;
+	else if (variable_type == "int32" || variable_type == "uint32") return 4;
+	else if (variable_type == "int16" || variable_type == "uint16") return 2;
+	else if (variable_type == "int8" || variable_type == "uint8" || variable_type == "byte" 
+		|| variable_type == "bool" || variable_type == "boolean") return 1;
+	else if (variable_type == "void") return 0;
+}
+
+const Variable& Compiler::GetLocalVariableReference(const uint32 symbol) const
+{
+	const Variable* variable = m_LocalVariables.Find(symbol);
+	return variable ? *variable : UNKNOWN_VARIABLE;
+}
+
+const Function& Compiler::GetFunction(const uint32 symbol) const
+{
+	const Function* function = m_Functions.Find(symbol);
+	return function ? *function : UNKNOWN_FUNCTION;
+}
+
+Operand Compiler::GetCorrectVariableMathematicsRegisterGrade1(int32 variable_size) const
+{
+	return arhi::SizedRegister(ERegister::Rax, variable_size);
+}
+
+Operand Compiler::GetCorrectVariableMathematicsRegisterGrade2(int32 variable_size) const
+{
+	return arhi::SizedRegister(ERegister::Rbx, variable_size);
+}
+
+Operand Compiler::GetCorrectVariableMathematicsRegisterGrade3(int32 variable_size) const
+{
+	return arhi::SizedRegister(ERegister::Rcx, variable_size);
 }
 
-std::string Compiler::GetParameterRegister(const uint32 parameter_num, const int32 parameter_size) const
+Operand Compiler::GetCorrectVariableMathematicsRegisterGrade4(int32 variable_size) const
 {
-	static const char* registers_64[] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
-	static const char* registers_32[] = { "edi", "esi", "edx", "ecx", "r8d", "r9d" };
-	static const char* registers_16[] = { "di", "si", "dx", "cx", "r8w", "r9w" };
-	static const char* registers_8[] = { "dil", "sil", "dl", "cl", "r8b", "r9b" };
+	return arhi::SizedRegister(ERegister::Rdx, variable_size);
+}
 
+Operand Compiler::GetParameterRegister(const uint32 parameter_num, const int32 parameter_size) const
+{
 	if (parameter_num >= 6)
 	{
 		std::cout << "[Error] Unsupported parameter number -> functions only support 6 parameters... Other parameters will be ignored!\n";
-		return "";
+		return {};
 	}
 
-	switch (parameter_size)
+	const Operand parameter_register = arhi::SizedRegister(arhi::PARAMETER_REGISTERS[parameter_num], parameter_size);
+	if (parameter_register.empty())
 	{
-	case 8:
-		return registers_64[parameter_num];
-	case 4:
-		return registers_32[parameter_num];
-	case 2:
-		return registers_16[parameter_num];
-	case 1:
-		return registers_8[parameter_num];
-	default:
 		std::cout << "[Error] Unsupported parameter size: valid sizes are 1, 2, 4, or 8 bytes...\n";
 	}
+
+	return parameter_register;
+}
+
+Operand Compiler::GetVariableOperand(const Variable& variable, const int32 access_size, const bool bPrintSize) const
+{
+	return Operand::StackSlot(variable.stack_slot, static_cast<uint8>(access_size), bPrintSize);
+}
+
+Operand Compiler::GetNumericOperand(const Token& token) const
+{
+	// Numeric tokens can chain subtractions like "10-3", which the assembler used to fold for us
+	const char* current = token.value.data();
+	const char* const end = token.value.data() + token.value.length();
+
+	int64 value = 0;
+	std::from_chars_result result = std::from_chars(current, end, value);
+	while (result.ec == std::errc() && result.ptr != end && *result.ptr == '-')
+	{
+		int64 subtrahend = 0;
+		result = std::from_chars(result.ptr + 1, end, subtrahend);
+		value -= subtrahend;
+	}
+
+	if (result.ec != std::errc() || result.ptr != end)
+	{
+		std::cerr << "[Error] '" << token.value << "' is not a valid number! Line " << m_CurrentLine << "\n";
+	}
+
+	return Operand::Immediate(value);
 }
 
-void Compiler::Compare(const std::vector<Token>& left, const std::vector<Token>& right, std::ofstream& output_file)
+void Compiler::Compare(const std::vector<Token>& left, const std::vector<Token>& right, MachineProgram& program)
 {
-	HandleComplexAssignment(left, output_file, "rcx", 8, EAssignmentType::NotSpecified);
-	HandleComplexAssignment(right, output_file, "rdx", 8, EAssignmentType::NotSpecified);
-	output_file << " cmp rcx, rdx\n";
+	const Operand left_register = Operand::Register(ERegister::Rcx, 8);
+	const Operand right_register = Operand::Register(ERegister::Rdx, 8);
+
+	HandleComplexAssignment(left, program, left_register, 8, EAssignmentType::NotSpecified);
+	HandleComplexAssignment(right, program, right_register, 8, EAssignmentType::NotSpecified);
+	program.Emit(EOpcode::Cmp, left_register, right_register);
 }
 
-bool Compiler::IsBoolean(const std::string& variable_type) const
+bool Compiler::IsBoolean(std::string_view variable_type) const
 {
 	return variable_type == "bool" || variable_type == "boolean";
 }
@@ -462,7 +1135,7 @@ bool Compiler::IsComplexIfStatement(const std::vector<Token>& tokens) const
 	return false;
 }
 
-EAssignmentType Compiler::GetAssignmentType(const std::string& variable_type) const
+EAssignmentType Compiler::GetAssignmentType(std::string_view variable_type) const
 {
 	if (variable_type == "float") return EAssignmentType::FloatingPoint;
 	else if (variable_type == "bool" || variable_type == "boolean") return EAssignmentType::Boolean;
@@ -506,76 +1179,70 @@ std::string Compiler::TokenTypeToString(ETokenType type) const
 	}
 }
 
-std::string Compiler::GetAssemblyTypesizeSpecifier(const int32 size) const
-{
-	if (size == 8) return "qword";
-	if (size == 4) return "dword";
-	if (size == 2) return "word";
-	if (size == 1) return "byte";
-	else return "";
-}
-
-std::string Compiler::GetConditionCodeEnding(const Token& condition) const
+ECondition Compiler::GetCondition(const Token& condition) const
 {
 	if (condition.value == "==" || condition.value == "?")
 	{
-		return "e";
+		return ECondition::Equal;
 	}
 	else if (condition.value == ">")
 	{
-		return "g";
+		return ECondition::Greater;
 	}
 	else if (condition.value == ">=")
 	{
-		return "ge";
+		return ECondition::GreaterEqual;
 	}
 	else if (condition.value == "<")
 	{
-		return "l";
+		return ECondition::Less;
 	}
 	else if (condition.value == "<=")
 	{
-		return "le";
+		return ECondition::LessEqual;
 	}
 	else if (condition.value == "!=")
 	{
-		return "ne";
+		return ECondition::NotEqual;
 	}
 
-	return std::string();
+	return ECondition::None;
 }
 
-void Compiler::MoveByCondition(const std::vector<Token>& ifworth, const std::vector<Token>& elseworth, const Token& condition, const std::string& expected_location, const int32 result_size, std::ofstream& output_file)
+void Compiler::MoveByCondition(const std::vector<Token>& left, const std::vector<Token>& right, const std::vector<Token>& ifworth, const std::vector<Token>& elseworth, const Token& condition, const Operand& expected_location, const int32 result_size, MachineProgram& program)
 {
-	const std::string register_second_grade = GetCorrectVariableMathematicsRegisterGrade2(result_size);
-
-	output_file << " pushf\n";
-	const std::string keyword = " cmov" + GetConditionCodeEnding(condition);
-	HandleComplexAssignment(ifworth, output_file, register_second_grade,
-		result_size, EAssignmentType::NotSpecified);
-	HandleComplexAssignment(elseworth, output_file, expected_location,
-		result_size, EAssignmentType::NotSpecified);
-	output_file << " popf\n";
-	output_file << keyword << " " << expected_location << ", " << register_second_grade << "\n";
+	// Both values are ready before the cmp, nothing between it and the cmov touches the flags
+	const Operand ifworth_value = Operand::StackSlot(program.CreateStackSlot(static_cast<uint8>(result_size)), static_cast<uint8>(result_size));
+	const Operand elseworth_value = Operand::StackSlot(program.CreateStackSlot(static_cast<uint8>(result_size)), static_cast<uint8>(result_size));
+	HandleComplexAssignment(ifworth, program, ifworth_value, result_size, EAssignmentType::NotSpecified);
+	HandleComplexAssignment(elseworth, program, elseworth_value, result_size, EAssignmentType::NotSpecified);
+
+	Compare(left, right, program);
+	program.Emit(EOpcode::Mov, expected_location, elseworth_value);
+	program.Emit(EOpcode::Cmovcc, expected_location, ifworth_value, GetCondition(condition));
 }
 
-void Compiler::Move(std::ofstream& output_file, const std::string& destination, const std::string& source, const int32 destination_size, const int32 source_size)
+void Compiler::Move(MachineProgram& program, const Operand& destination, const Operand& source, const int32 destination_size, const int32 source_size)
 {
 	if (destination_size > source_size && source_size <= 2)
 	{
-		output_file << " movzx " << destination << ", " << GetAssemblyTypesizeSpecifier(source_size) << " " << source << "\n";
+		program.Emit(EOpcode::Movzx, destination, source.WithSize(static_cast<uint8>(source_size), true));
 		return;
 	}
-	else if (destination_size < source_size && source_size <= 2)
+	else if (destination_size > source_size && source_size == 4 && destination.IsRegister())
 	{
-		output_file << " movsx " << destination << ", " << GetAssemblyTypesizeSpecifier(source_size) << " " << source << "\n";
+		// Writing the 32 bit register zero extends like movzx, without reading past the 4 bytes of the source
+		program.Emit(EOpcode::Mov, destination.WithSize(4, false), source.WithSize(4, false));
 		return;
 	}
 
-	output_file << " mov " << destination << ", " << source << "\n";
+	// A plain move accesses memory with the width of the register on the other side
+	if (source.IsMemory() && destination.IsRegister()) program.Emit(EOpcode::Mov, destination, source.WithSize(destination.size, source.bPrintSize));
+	else if (destination.IsMemory() && source.IsRegister()) program.Emit(EOpcode::Mov, destination.WithSize(source.size, destination.bPrintSize), source);
+	else program.Emit(EOpcode::Mov, destination, source);
 }
 
-void Compiler::HandleNegateMacro(const std::vector<Token>& tokens, std::ofstream& output_file)
+void Compiler::HandleNegateMacro(const std::vector<Token>& tokens, MachineProgram& program)
 {
 	std::vector<Token> first_param_tokens = {};
 	int32 i = 2;
@@ -588,8 +1255,8 @@ void Compiler::HandleNegateMacro(const std::vector<Token>& tokens, std::ofstream
 	}
 	if (tokens[tokens.size() - 3].type == ETokenType::Name)
 	{
-		variable = GetLocalVariableReference(tokens[tokens.size() - 3].value);
-		if (!IsCorrectVariableName(tokens[tokens.size() - 3].value, variable.variable_assembly_safe + "]")) return;
+		variable = GetLocalVariableReference(tokens[tokens.size() - 3].symbol);
+		if (!IsCorrectVariableName(tokens[tokens.size() - 3].value, variable.symbol)) return;
 		if (variable.bUnsigned)
 		{
 			std::cerr << "[Error] You cannot negate unsigned variables!\n";
@@ -597,23 +1264,15 @@ void Compiler::HandleNegateMacro(const std::vector<Token>& tokens, std::ofstream
 		}
 	}
 
-	const std::string assembly_typesize_specifier = GetAssemblyTypesizeSpecifier(variable.type_size);
-
-	std::string correct_register_grade_one = GetCorrectVariableMathematicsRegisterGrade1(variable.type_size);
-	HandleComplexAssignment(first_param_tokens, output_file,
+	const Operand correct_register_grade_one = GetCorrectVariableMathematicsRegisterGrade1(variable.type_size);
+	HandleComplexAssignment(first_param_tokens, program,
 		correct_register_grade_one, variable.type_size, EAssignmentType::NotSpecified);
 
-	if (variable.type_size == 1)
-	{
-		output_file << " movsx ax, al\n";
-		correct_register_grade_one = "ax";
-	}
-	output_file << " imul " << correct_register_grade_one << ", -1\n";
-	if (variable.type_size == 1) correct_register_grade_one = "al";
-	output_file << " mov " << assembly_typesize_specifier << " " << variable.variable_assembly_safe + "]" << ", " << correct_register_grade_one << "\n";
+	program.Emit(EOpcode::Neg, correct_register_grade_one);
+	program.Emit(EOpcode::Mov, GetVariableOperand(variable, variable.type_size, true), correct_register_grade_one);
 }
 
-void Compiler::HandleClampMacro(const std::vector<Token>& tokens, std::ofstream& output_file)
+void Compiler::HandleClampMacro(const std::vector<Token>& tokens, MachineProgram& program)
 {
 	Variable variable = {};
 	std::vector<Token> max_value = {};
@@ -639,10 +1298,10 @@ void Compiler::HandleClampMacro(const std::vector<Token>& tokens, std::ofstream&
 
 		if (parameter == 0)
 		{
-			if (variable.variable_name == "")
+			if (variable.symbol == INVALID_SYMBOL)
 			{
-				variable = GetLocalVariableReference(tokens[i].value);
-				if (!IsCorrectVariableName(tokens[i].value, variable.variable_assembly_safe + "]")) return;
+				variable = GetLocalVariableReference(tokens[i].symbol);
+				if (!IsCorrectVariableName(tokens[i].value, variable.symbol)) return;
 			}
 			else
 			{
@@ -662,27 +1321,27 @@ void Compiler::HandleClampMacro(const std::vector<Token>& tokens, std::ofstream&
 		i++;
 	}
 
-	const std::string correct_register_first = GetCorrectVariableMathematicsRegisterGrade1(variable.type_size);
-	const std::string correct_register_second = GetCorrectVariableMathematicsRegisterGrade2(variable.type_size);
-	const std::string correct_compare_register = GetCorrectVariableMathematicsRegisterGrade3(variable.type_size);
-	HandleComplexAssignment(min_value, output_file,
+	const Operand correct_register_first = GetCorrectVariableMathematicsRegisterGrade1(variable.type_size);
+	const Operand correct_register_second = GetCorrectVariableMathematicsRegisterGrade2(variable.type_size);
+	const Operand correct_compare_register = GetCorrectVariableMathematicsRegisterGrade3(variable.type_size);
+	HandleComplexAssignment(min_value, program,
 		correct_compare_register, variable.type_size, EAssignmentType::NotSpecified);
 
-	output_file << " mov " << correct_register_first << ", " << variable.variable_assembly_safe << "]\n";
-	output_file << " cmp eax, " << correct_compare_register << "\n";
-	output_file << " mov " << correct_register_second << ", " << correct_compare_register << "\n";
-	output_file << " cmovl " << correct_register_first << ", " << correct_register_second << "\n";
+	program.Emit(EOpcode::Mov, correct_register_first, GetVariableOperand(variable, variable.type_size));
+	program.Emit(EOpcode::Cmp, correct_register_first, correct_compare_register);
+	program.Emit(EOpcode::Mov, correct_register_second, correct_compare_register);
+	program.Emit(EOpcode::Cmovcc, correct_register_first, correct_register_second, ECondition::Less);
 
-	HandleComplexAssignment(max_value, output_file,
+	HandleComplexAssignment(max_value, program,
 		correct_compare_register, variable.type_size, EAssignmentType::NotSpecified);
 
-	output_file << " cmp eax, " << correct_compare_register << "\n";
-	output_file << " mov " << correct_register_second << ", " << correct_compare_register << "\n";
-	output_file << " cmovg " << correct_register_first << ", " << correct_register_second << "\n";
-	output_file << " mov " << GetAssemblyTypesizeSpecifier(variable.type_size) << " " << variable.variable_assembly_safe << "], " << correct_register_first << "\n";
+	program.Emit(EOpcode::Cmp, correct_register_first, correct_compare_register);
+	program.Emit(EOpcode::Mov, correct_register_second, correct_compare_register);
+	program.Emit(EOpcode::Cmovcc, correct_register_first, correct_register_second, ECondition::Greater);
+	program.Emit(EOpcode::Mov, GetVariableOperand(variable, variable.type_size, true), correct_register_first);
 }
 
-void Compiler::HandleRepeatMacro(const std::vector<Token>& tokens, std::ofstream& output_file)
+void Compiler::HandleRepeatMacro(const std::vector<Token>& tokens, MachineProgram& program)
 {
 	std::vector<Token> first_parameter = {};
 	std::vector<std::vector<Token>> second_parameter = {};
@@ -693,7 +1352,8 @@ void Compiler::HandleRepeatMacro(const std::vector<Token>& tokens, std::ofstream
 	bool add_new_list_second_parameter = true;
 	while (i < tokens.size())
 	{
-		if (tokens[i].value == ",") 
+		// Commas of calls in the body belong to the body
+		if (tokens[i].value == "," && parameter == 0 && paranthesis == 1)
 		{
 			parameter++;
 			i++;
@@ -764,21 +1424,104 @@ void Compiler::HandleRepeatMacro(const std::vector<Token>& tokens, std::ofstream
 		i++;
 	}
 
-	HandleComplexAssignment(first_parameter, output_file, "r8", 8, EAssignmentType::Integer);
-	output_file << "REPEAT" << m_SectionNumber << ":\n";
+	size_t body_token_count = 0;
+	bool bDuplicable = true;
+	for (const std::vector<Token>& statement : second_parameter)
+	{
+		body_token_count += statement.size();
+		// Every copy of the body would declare its locals again
+		if (!statement.empty() && statement[0].value == "local") bDuplicable = false;
+	}
+
+	const int32 section = m_SectionNumber++;
+	const auto emit_body = [&](const int64 copy_count)
+	{
+		bool nothing = false;
+		for (int64 copy = 0; copy < copy_count; copy++)
+		{
+			for (const std::vector<Token>& statement : second_parameter) CompileToken(statement, program, nothing);
+		}
+	};
 
-	bool nothing = false;
-	for (const std::vector<Token>& second_parameter_token : second_parameter)
+	// The counter gets a stack slot of its own, the register allocator keeps it in a register no call of the body clobbers
+	const Operand counter = Operand::StackSlot(program.CreateStackSlot(8), 8, true);
+	int64 copies_per_iteration = 1;
+	int64 remaining_copies = 0;
+	// Block of the jump past the loop for counts known at run time only, SIZE_MAX for literal ones
+	size_t guard_block = SIZE_MAX;
+	if (first_parameter.size() == 1 && first_parameter[0].type == ETokenType::Numeric && bDuplicable)
 	{
-		CompileToken(second_parameter_token, output_file, nothing);
+		const Operand count = GetNumericOperand(first_parameter[0]);
+		if (count.empty() || count.value <= 0) return;
+
+		// Small loops are copied out completely, larger ones copy the body a few times per iteration and the rest behind the loop
+		const int64 copy_budget = static_cast<int64>(std::max<size_t>(arhi::UNROLL_TOKEN_BUDGET / std::max<size_t>(body_token_count, 1), 1));
+		if (count.value <= std::min(copy_budget, arhi::MAX_FULL_UNROLL_COUNT))
+		{
+			emit_body(count.value);
+			return;
+		}
+
+		copies_per_iteration = std::min(copy_budget, arhi::MAX_UNROLL_FACTOR);
+		remaining_copies = count.value % copies_per_iteration;
+		const int64 iteration_count = count.value / copies_per_iteration;
+		if (iteration_count == 1)
+		{
+			emit_body(count.value);
+			return;
+		}
+
+		program.Emit(EOpcode::Mov, counter, Operand::Immediate(iteration_count));
 	}
+	else
+	{
+		// The count takes the size of the widest variable in it, narrower signed counts are sign extended into the counter
+		int32 count_size = 4;
+		bool bUnsignedCount = false;
+		for (const Token& token : first_parameter)
+		{
+			const Variable& variable = GetLocalVariableReference(token.symbol);
+			if (token.type != ETokenType::Name || variable.symbol == INVALID_SYMBOL) continue;
+
+			count_size = std::max(count_size, static_cast<int32>(variable.type_size));
+			bUnsignedCount |= variable.bUnsigned;
+		}
 
-	output_file << " dec r8\n";
-	output_file << " jnz REPEAT" << m_SectionNumber << "\n";
-	m_SectionNumber++;
+		if (count_size == 8)
+		{
+			HandleComplexAssignment(first_parameter, program, counter, 8, EAssignmentType::Integer);
+		}
+		else
+		{
+			const Operand count = Operand::StackSlot(program.CreateStackSlot(static_cast<uint8>(count_size)), static_cast<uint8>(count_size), true);
+			const Operand count_register = GetCorrectVariableMathematicsRegisterGrade1(8);
+			HandleComplexAssignment(first_parameter, program, count, count_size, EAssignmentType::Integer);
+
+			if (bUnsignedCount) Move(program, count_register, count, 8, count_size);
+			else program.Emit(EOpcode::Movsxd, count_register, count);
+			program.Emit(EOpcode::Mov, counter, count_register);
+		}
+
+		// A count of 0 or less runs the body never, like a literal one, instead of wrapping around
+		program.Emit(EOpcode::Cmp, counter, Operand::Immediate(0));
+		program.Emit(EOpcode::Jcc, Operand::Label(0), {}, ECondition::LessEqual);
+		guard_block = program.GetFunctions().back().blocks.size() - 1;
+	}
+
+	const uint32 loop_block = program.BeginBlock("REPEAT" + std::to_string(section), arhi::LOOP_ALIGNMENT);
+	emit_body(copies_per_iteration);
+	program.Emit(EOpcode::Dec, counter);
+	program.Emit(EOpcode::Jcc, Operand::Label(loop_block), {}, ECondition::NotEqual);
+	if (guard_block != SIZE_MAX)
+	{
+		// The block behind the loop only exists now, the jump past the loop gets its target afterwards
+		const uint32 end_block = program.BeginBlock("REPEAT" + std::to_string(section) + "_END");
+		program.GetFunctions().back().blocks[guard_block].instructions.back().destination = Operand::Label(end_block);
+	}
+	emit_body(remaining_copies);
 }
 
-void Compiler::HandleSwapMacro(const std::vector<Token>& tokens, std::ofstream& output_file)
+void Compiler::HandleSwapMacro(const std::vector<Token>& tokens, MachineProgram& program)
 {
 	Variable first_parameter = {};
 	Variable second_parameter = {};
@@ -794,8 +1537,8 @@ void Compiler::HandleSwapMacro(const std::vector<Token>& tokens, std::ofstream&
 
 		if (tokens[i].type == ETokenType::Name)
 		{
-			const Variable variable = GetLocalVariableReference(tokens[i].value);
-			if (!IsCorrectVariableName(tokens[i].value, variable.variable_name)) return;
+			const Variable& variable = GetLocalVariableReference(tokens[i].symbol);
+			if (!IsCorrectVariableName(tokens[i].value, variable.symbol)) return;
 			
 			if (parameter == 0) first_parameter = variable;
 			else if (parameter == 1) second_parameter = variable;
@@ -804,82 +1547,74 @@ void Compiler::HandleSwapMacro(const std::vector<Token>& tokens, std::ofstream&
 
 	if (!CheckTypeSize(first_parameter, second_parameter)) return;
 
-	const std::string correct_register_grade_one = GetCorrectVariableMathematicsRegisterGrade1(first_parameter.type_size);
-	const std::string correct_register_grade_two = GetCorrectVariableMathematicsRegisterGrade2(second_parameter.type_size);
-	output_file << " mov " << correct_register_grade_one << ", " << first_parameter.variable_assembly_safe << "]\n";
-	output_file << " mov " << correct_register_grade_two << ", " << second_parameter.variable_assembly_safe << "]\n";
-	output_file << " xchg " << correct_register_grade_one << ", " << correct_register_grade_two << "\n";
-	output_file << " mov " << GetAssemblyTypesizeSpecifier(first_parameter.type_size) << " " << first_parameter.variable_assembly_safe << "]" << ", " << correct_register_grade_one << "\n";
-	output_file << " mov " << GetAssemblyTypesizeSpecifier(second_parameter.type_size) << " " << second_parameter.variable_assembly_safe << "]" << ", " << correct_register_grade_two << "\n";
+	const Operand correct_register_grade_one = GetCorrectVariableMathematicsRegisterGrade1(first_parameter.type_size);
+	const Operand correct_register_grade_two = GetCorrectVariableMathematicsRegisterGrade2(second_parameter.type_size);
+	program.Emit(EOpcode::Mov, correct_register_grade_one, GetVariableOperand(first_parameter, first_parameter.type_size));
+	program.Emit(EOpcode::Mov, correct_register_grade_two, GetVariableOperand(second_parameter, second_parameter.type_size));
+	program.Emit(EOpcode::Xchg, correct_register_grade_one, correct_register_grade_two);
+	program.Emit(EOpcode::Mov, GetVariableOperand(first_parameter, first_parameter.type_size, true), correct_register_grade_one);
+	program.Emit(EOpcode::Mov, GetVariableOperand(second_parameter, second_parameter.type_size, true), correct_register_grade_two);
 }
 
-void Compiler::HandleMacros(const std::vector<Token>& tokens, std::ofstream& output_file, bool& bUseExitCode)
+void Compiler::HandleMacros(const std::vector<Token>& tokens, MachineProgram& program, bool& bUseExitCode)
 {
 	if (tokens[0].value == "exit!")
 	{
-		const std::string correct_register = GetCorrectVariableMathematicsRegisterGrade3(8);
-		HandleComplexAssignment(std::vector<Token>(tokens.begin() + 2, tokens.end() - 2), output_file,
+		const Operand correct_register = GetCorrectVariableMathematicsRegisterGrade3(8);
+		HandleComplexAssignment(std::vector<Token>(tokens.begin() + 2, tokens.end() - 2), program,
 			correct_register, 8, EAssignmentType::Integer);
 
-		output_file << " mov rax, 60\n";
-		output_file << " mov rdi, rcx\n";
-		output_file << " syscall\n";
+		program.Emit(EOpcode::Mov, Operand::Register(ERegister::Rax, 8), Operand::Immediate(60));
+		program.Emit(EOpcode::Mov, Operand::Register(ERegister::Rdi, 8), correct_register);
+		program.Emit(EOpcode::Syscall);
 
 		bUseExitCode = true;
 	}
 	else if (tokens[0].value == "negate!")
 	{
-		HandleNegateMacro(tokens, output_file);
+		HandleNegateMacro(tokens, program);
 	}
 	else if (tokens[0].value == "clamp!")
 	{
-		HandleClampMacro(tokens, output_file);
+		HandleClampMacro(tokens, program);
 	}
 	else if (tokens[0].value == "repeat!")
 	{
-		HandleRepeatMacro(tokens, output_file);
+		HandleRepeatMacro(tokens, program);
 	}
 	else if (tokens[0].value == "swap!")
 	{
-		HandleSwapMacro(tokens, output_file);
+		HandleSwapMacro(tokens, program);
 	}
 }
 
-void Compiler::HandleScope(const std::vector<Token>& tokens, std::ofstream& output_file)
+void Compiler::HandleScope(const std::vector<Token>& tokens, MachineProgram& program)
 {
 	if (tokens[0].value == "{")
 	{
-		output_file << " push rbp\n";
-		output_file << " mov rbp, rsp\n";
-
-		m_CurrentStacksizes.push_back(0);
-		m_LocalVariables.push_back(std::vector<Variable>());
+		m_LocalVariables.PushScope();
 
 		if (m_pCurrentFunction)
 		{
 			if (m_RemainingFunctionScopes == 0)
 			{
-				HandleVariableParameters(m_pCurrentFunction->function_parameters, output_file);
+				HandleVariableParameters(m_pCurrentFunction->function_parameters, program);
 			}
 		}
 		m_RemainingFunctionScopes++;
 	}
 	else if (tokens[0].value == "}")
 	{
-		output_file << " mov rsp, rbp\n";
-		output_file << " pop rbp\n";
-
-		m_CurrentStacksizes.pop_back();
-		m_LocalVariables.pop_back();
+		m_LocalVariables.PopScope();
 
 		m_RemainingFunctionScopes--;
 		if (m_RemainingFunctionScopes == 0)
 		{
 			if (m_pCurrentFunction)
 			{
-				if (m_pCurrentFunction->function_name != "main")
+				if (m_pCurrentFunction->symbol != m_MainSymbol)
 				{
-					output_file << " ret\n";
+					program.Emit(EOpcode::Ret);
 				}
 			}
 
@@ -888,57 +1623,67 @@ void Compiler::HandleScope(const std::vector<Token>& tokens, std::ofstream& outp
 	}
 }
 
-bool Compiler::HandleVariableChanges(const std::vector<Token>& tokens, std::ofstream& output_file)
+bool Compiler::HandleVariableChanges(const std::vector<Token>& tokens, MachineProgram& program)
 {
 	if (tokens[1].type == ETokenType::Operator)
 	{
-		const Variable variable_reference = GetLocalVariableReference(tokens[0].value);
-		if (IsCorrectVariableName(tokens[0].value, variable_reference.variable_name))
+		const Variable& variable_reference = GetLocalVariableReference(tokens[0].symbol);
+		if (IsCorrectVariableName(tokens[0].value, variable_reference.symbol))
 		{
-			const std::string correct_register = GetCorrectVariableMathematicsRegisterGrade1(variable_reference.type_size);
-			output_file << " mov " << correct_register + ", " << variable_reference.variable_assembly_safe << "]\n";
-			if (tokens[1].value == "++") output_file << " inc " << correct_register << "\n";
-			else if (tokens[1].value == "--") output_file << " dec " << correct_register << "\n";
-			output_file << " mov " << variable_reference.variable_assembly_safe << "], " << correct_register << "\n";
-			
+			// Increments the variable where it lives, a memory operand needs its size printed
+			const Operand variable_location = GetVariableOperand(variable_reference, variable_reference.type_size, true);
+			if (tokens[1].value == "++") program.Emit(EOpcode::Inc, variable_location);
+			else if (tokens[1].value == "--") program.Emit(EOpcode::Dec, variable_location);
+
 			return true;
 		}
 	}
 	else if (tokens[1].type == ETokenType::Assignment)
 	{
-		const Variable write_to_reference = GetLocalVariableReference(tokens[0].value);
+		const Variable& write_to_reference = GetLocalVariableReference(tokens[0].symbol);
 
-		return HandleComplexAssignment(std::vector<Token>(tokens.begin() + 2, tokens.end() - 1), output_file,
-			write_to_reference.variable_assembly_safe + "]", write_to_reference.type_size, GetAssignmentType(write_to_reference.type));
+		return HandleComplexAssignment(std::vector<Token>(tokens.begin() + 2, tokens.end() - 1), program,
+			GetVariableOperand(write_to_reference, write_to_reference.type_size), write_to_reference.type_size, GetAssignmentType(write_to_reference.type));
 	}
 	else if (tokens[1].type == ETokenType::Referral)
 	{
-		bool bIsValid = true;
-
-		const Variable write_to_reference = GetLocalVariableReference(tokens[0].value);
+		const Variable& write_to_reference = GetLocalVariableReference(tokens[0].symbol);
 		if (tokens[2].type != ETokenType::Numeric)
 		{
 			std::cerr << "[Error] Expected a numeric literal (number), but got " << TokenTypeToString(tokens[2].type) << " -> '" << tokens[2].value << "'! Line " << m_CurrentLine << "\n";
-			bIsValid = false;
+			return false;
 		}
 
-		const std::string correct_register = GetCorrectVariableMathematicsRegisterGrade1(write_to_reference.type_size);
-		output_file << " mov " << correct_register << ", " << tokens[2].value << "\n";
-		output_file << " mov " << write_to_reference.variable_assembly_safe << "], " + correct_register + "\n";
+		const Operand number = GetNumericOperand(tokens[2]);
+		if (number.empty()) return false;
+
+		const Operand variable_location = GetVariableOperand(write_to_reference, write_to_reference.type_size, true);
+		const int64 value = arhi::TruncateToSize(number.value, variable_location.size);
+		if (value >= INT32_MIN && value <= INT32_MAX)
+		{
+			program.Emit(EOpcode::Mov, variable_location, Operand::Immediate(value));
+		}
+		else
+		{
+			// mov only stores 32 bit immediates
+			const Operand correct_register = GetCorrectVariableMathematicsRegisterGrade1(write_to_reference.type_size);
+			program.Emit(EOpcode::Mov, correct_register, number);
+			program.Emit(EOpcode::Mov, variable_location, correct_register);
+		}
 
-		return bIsValid;
+		return true;
 	}
 
 	std::cerr << "[Error] Expected an (assignment) operator, but got " << TokenTypeToString(tokens[1].type) << " -> '" << tokens[1].value << "'! Line " << m_CurrentLine << "\n";
 	return false;
 }
 
-void Compiler::HandleVariableDecleration(const std::vector<Token>& tokens, std::ofstream& output_file)
+void Compiler::HandleVariableDecleration(const std::vector<Token>& tokens, MachineProgram& program)
 {
 	bool bIsArray = false;
 	if (tokens[0].type != ETokenType::Keyword)
 	{
-		std::cerr << "[Error] Expected a keyword like local or global, but got '" + tokens[0].value << "'! Line: " << m_CurrentLine << "\n";
+		std::cerr << "[Error] Expected a keyword like local or global, but got '" << tokens[0].value << "'! Line: " << m_CurrentLine << "\n";
 	}
 	if (tokens[1].type != ETokenType::Name)
 	{
@@ -973,8 +1718,8 @@ void Compiler::HandleVariableDecleration(const std::vector<Token>& tokens, std::
 
 	if (tokens[0].value == "local")
 	{
-		bool bUnsigned = false;
-		if (tokens[3].value[0] == 'u')
+		const bool bUnsigned = tokens[3].value[0] == 'u';
+		if (bUnsigned)
 		{
 			if (tokens[5].value[0] == '-')
 			{
@@ -985,10 +1730,8 @@ void Compiler::HandleVariableDecleration(const std::vector<Token>& tokens, std::
 
 		const uint32 size = GetVariableSize(tokens[3].value);
 
-		m_CurrentStacksizes[m_CurrentStacksizes.size() - 1] += size;
-
-		std::string stack_position = "[rbp-" + std::to_string(m_CurrentStacksizes[m_CurrentStacksizes.size() - 1]);
-		m_LocalVariables[m_LocalVariables.size() - 1].push_back(Variable(tokens[1].value, stack_position, tokens[3].value, size, bUnsigned, false, IsBoolean(tokens[3].value), bIsArray));
+		const uint32 stack_slot = program.CreateStackSlot(static_cast<uint8>(size));
+		const Variable& variable = m_LocalVariables.Declare(Variable(tokens[1].symbol, stack_slot, std::string(tokens[3].value), size, bUnsigned, false, IsBoolean(tokens[3].value), bIsArray));
 
 		if (bIsArray)
 		{
@@ -1003,53 +1746,49 @@ void Compiler::HandleVariableDecleration(const std::vector<Token>& tokens, std::
 		}
 		else
 		{
-			std::string value = {};
-			if (size == 8) value = "qword " + stack_position + "]";
-			if (size == 4) value = "dword " + stack_position + "]";
-			if (size == 2) value = "word " + stack_position + "]";
-			if (size == 1) value = "byte " + stack_position + "]";
-
-			output_file << " sub rsp, " << size << "\n";
 			const std::vector<Token> assignment_tokens = std::vector<Token>(tokens.begin() + 5, tokens.end() - 1);
-			HandleComplexAssignment(assignment_tokens, output_file,
-				value, size, GetAssignmentType(tokens[3].value));
+			HandleComplexAssignment(assignment_tokens, program,
+				GetVariableOperand(variable, size, true), size, GetAssignmentType(tokens[3].value));
 		}
 	}
 }
 
-void Compiler::HandleVariableParameters(const std::vector<Variable>& parameters, std::ofstream& output_file)
+void Compiler::HandleVariableParameters(const std::vector<Variable>& parameters, MachineProgram& program)
 {
 	uint32 parameter_num = 0;
 
-	uint32 type_size = 0;
-	for (const Variable& variable : parameters) type_size = type_size + variable.type_size;
-	if (type_size > 0) output_file << " sub rsp, " << type_size << "\n";
-
 	for (const Variable& variable : parameters)
 	{
-		const std::string correct_register = GetParameterRegister(parameter_num, variable.type_size);
+		const Operand correct_register = GetParameterRegister(parameter_num, variable.type_size);
 		if (!correct_register.empty())
 		{
-			if (variable.type_size == 8) output_file << " mov qword " << variable.variable_assembly_safe << "], " << correct_register << "\n";
-			else if (variable.type_size == 4) output_file << " mov dword " << variable.variable_assembly_safe << "], " << correct_register << "\n";
-			else if (variable.type_size == 2) output_file << " mov word " << variable.variable_assembly_safe << "], " << correct_register << "\n";
-			else if (variable.type_size == 1) output_file << " mov byte " << variable.variable_assembly_safe << "], " << correct_register << "\n";
+			program.Emit(EOpcode::Mov, GetVariableOperand(variable, variable.type_size, true), correct_register);
 
-			m_LocalVariables.push_back({ variable });
-			m_CurrentStacksizes[m_CurrentStacksizes.size() - 1] += variable.type_size;
+			m_LocalVariables.Declare(variable);
 
 			parameter_num++;
 		}
 	}
 }
 
-void Compiler::HandleFunctionDecleration(const std::vector<Token>& tokens, std::ofstream& output_file)
+void Compiler::HandleFunctionDecleration(const std::vector<Token>& tokens, MachineProgram& program)
 {
-	if (tokens[1].value == "main")
+	// "define inline name(...)" and "define noinline name(...)" decide for the inliner instead of the function size
+	if (tokens.size() > 2 && (tokens[1].value == "inline" || tokens[1].value == "noinline"))
+	{
+		std::vector<Token> declaration = tokens;
+		declaration.erase(declaration.begin() + 1);
+		HandleFunctionDecleration(declaration, program);
+
+		program.GetFunctions().back().inline_hint = tokens[1].value == "inline" ? EInlineHint::Always : EInlineHint::Never;
+		return;
+	}
+
+	if (tokens[1].symbol == m_MainSymbol)
 	{
 		if (tokens[0].type != ETokenType::Keyword)
 		{
-			std::cerr << "[Error] Expected a keyword (define), but got '" + tokens[0].value << "'! Line: " << m_CurrentLine << "\n";
+			std::cerr << "[Error] Expected a keyword (define), but got '" << tokens[0].value << "'! Line: " << m_CurrentLine << "\n";
 		}
 		if (tokens[2].type != ETokenType::Parenthesis)
 		{
@@ -1060,17 +1799,15 @@ void Compiler::HandleFunctionDecleration(const std::vector<Token>& tokens, std::
 			std::cerr << "[Error] Expected a closed parenthesi ')', but got " << TokenTypeToString(tokens[tokens.size() - 3].type) << " -> '" << tokens[tokens.size() - 3].value << "'! Line " << m_CurrentLine << "\n";
 		}
 
-		output_file << "_start:\n";
-
-		const Function function = Function("main", 8, {}, {});
-		m_Functions.push_back(function);
-		m_pCurrentFunction = &(m_Functions[m_Functions.size() - 1]);
+		Function function = Function(m_MainSymbol, 8, {}, {});
+		function.machine_function = program.BeginFunction("_start", true);
+		m_pCurrentFunction = &m_Functions.Declare(function);
 	}
 	else
 	{
 		if (tokens[0].type != ETokenType::Keyword)
 		{
-			std::cerr << "[Error] Expected a keyword (define), but got '" + tokens[0].value << "'! Line: " << m_CurrentLine << "\n";
+			std::cerr << "[Error] Expected a keyword (define), but got '" << tokens[0].value << "'! Line: " << m_CurrentLine << "\n";
 		}
 		if (tokens[1].type != ETokenType::Name)
 		{
@@ -1093,10 +1830,12 @@ void Compiler::HandleFunctionDecleration(const std::vector<Token>& tokens, std::
 			std::cerr << "[Error] Expected a variable type for the return value, but got " << TokenTypeToString(tokens[tokens.size() - 1].type) << " -> '" << tokens[tokens.size() - 1].value << "'! Line " << m_CurrentLine << "\n";
 		}
 
+		// The parameters get their stack slots in the new function
+		const uint32 machine_function = program.BeginFunction(std::string(tokens[1].value));
+
 		std::vector<Variable> parameters = {};
 		if (tokens.size() != 6)
 		{
-			int32 current_stack_size = 0;
 			for (int32 i = 3; i < tokens.size() - 3; i++)
 			{
 				if (tokens.at(i).value != ",")
@@ -1127,34 +1866,29 @@ void Compiler::HandleFunctionDecleration(const std::vector<Token>& tokens, std::
 					}
 					if (bError) continue;
 				
-					const std::string variable_type = tokens.at(i + 2).value;
-					const std::string variable_name = tokens.at(i).value;
+					const std::string variable_type = std::string(tokens.at(i + 2).value);
 
 					bool bUnsigned = variable_type[0] == 'u';
 
 					const int32 variable_size = GetVariableSize(variable_type);
-					current_stack_size = current_stack_size + variable_size;
-					const std::string assembly_stack_safe = "[rbp-" + std::to_string(current_stack_size);
-
-					const Variable variable = Variable(variable_name, assembly_stack_safe, variable_type, variable_size, bUnsigned, true, IsBoolean(variable_type), false);
+					const uint32 stack_slot = program.CreateStackSlot(static_cast<uint8>(variable_size));
+					const Variable variable = Variable(tokens.at(i).symbol, stack_slot, variable_type, variable_size, bUnsigned, true, IsBoolean(variable_type), false);
 					parameters.push_back(variable);
 					i = i + 3;
 				}
 			}
 		}
 
-		output_file << tokens[1].value << ":\n";
-
-		const Function function = Function(tokens[1].value, GetVariableSize(tokens[tokens.size() - 1].value), parameters, tokens[tokens.size() - 1].value);
-		m_Functions.push_back(function);
-		m_pCurrentFunction = &(m_Functions[m_Functions.size() - 1]);
+		Function function = Function(tokens[1].symbol, GetVariableSize(tokens[tokens.size() - 1].value), parameters, std::string(tokens[tokens.size() - 1].value));
+		function.machine_function = machine_function;
+		m_pCurrentFunction = &m_Functions.Declare(function);
 	}
 }
 
-int32 Compiler::HandleFunctionCall(const std::vector<Token>& tokens, std::ofstream& output_file)
+int32 Compiler::HandleFunctionCall(const std::vector<Token>& tokens, MachineProgram& program)
 {
-	const Function function = GetFunction(tokens[0].value);
-	if (IsCorrectFunctionName(tokens[0].value, function.function_name))
+	const Function& function = GetFunction(tokens[0].symbol);
+	if (IsCorrectFunctionName(tokens[0].value, function.symbol))
 	{
 		int32 closed_parenthesi_index = tokens.size() - 2;
 		if (tokens[tokens.size() - 1].value != ";") 
@@ -1171,6 +1905,7 @@ int32 Compiler::HandleFunctionCall(const std::vector<Token>& tokens, std::ofstre
 			std::cerr << "[Error] Expected a closed parenthesi ')', but got " << TokenTypeToString(tokens[closed_parenthesi_index].type) << " -> '" << tokens[closed_parenthesi_index].value << "'! Line " << m_CurrentLine << "\n";
 		}
 
+		const RegisterMask outer_argument_registers = m_LiveArgumentRegisters;
 		if (function.function_parameters.size() > 0)
 		{
 			const int32 tokens_length = tokens.size() - 1;
@@ -1191,52 +1926,52 @@ int32 Compiler::HandleFunctionCall(const std::vector<Token>& tokens, std::ofstre
 
 				if (parameter_tokens.size() > 0)
 				{
-					const std::string write_to_reference = GetParameterRegister(parameter_num, variable.type_size);
-					HandleComplexAssignment(parameter_tokens, output_file,
+					const Operand write_to_reference = GetParameterRegister(parameter_num, variable.type_size);
+					HandleComplexAssignment(parameter_tokens, program,
 						write_to_reference, variable.type_size, GetAssignmentType(variable.type));
+					m_LiveArgumentRegisters |= GetRegisterBit(write_to_reference.reg);
 				}
 
 				parameter_num++;
 			}
 		}
+		m_LiveArgumentRegisters = outer_argument_registers;
 
-		output_file << " call " << function.function_name << "\n";
+		program.Emit(EOpcode::Call, Operand::Function(function.machine_function));
 		return function.return_size;
 	}
 
 	return 0;
 }
 
-void Compiler::HandleReturnKeyword(const std::vector<Token>& tokens, std::ofstream& output_file)
+void Compiler::HandleReturnKeyword(const std::vector<Token>& tokens, MachineProgram& program)
 {
 	if (m_pCurrentFunction)
 	{
-		if (m_pCurrentFunction->function_name == "main")
+		if (m_pCurrentFunction->symbol == m_MainSymbol)
 		{
 			if (tokens.size() == 2)
 			{
-				output_file << " mov rax, 60\n";
-				output_file << " mov rdi, 0\n";
-				output_file << " syscall\n";
+				program.Emit(EOpcode::Mov, Operand::Register(ERegister::Rax, 8), Operand::Immediate(60));
+				program.Emit(EOpcode::Mov, Operand::Register(ERegister::Rdi, 8), Operand::Immediate(0));
+				program.Emit(EOpcode::Syscall);
 			}
 			else 
 			{
-				const std::string correct_register = GetCorrectVariableMathematicsRegisterGrade3(m_pCurrentFunction->return_size);
-				HandleComplexAssignment(std::vector<Token>(tokens.begin() + 1, tokens.end() - 1), output_file,
+				const Operand correct_register = GetCorrectVariableMathematicsRegisterGrade3(m_pCurrentFunction->return_size);
+				HandleComplexAssignment(std::vector<Token>(tokens.begin() + 1, tokens.end() - 1), program,
 					correct_register, m_pCurrentFunction->return_size, EAssignmentType::Integer);
 
-				output_file << " mov rax, 60\n";
-				output_file << " mov rdi, " << correct_register << "\n";
-				output_file << " syscall\n";
+				program.Emit(EOpcode::Mov, Operand::Register(ERegister::Rax, 8), Operand::Immediate(60));
+				program.Emit(EOpcode::Mov, Operand::Register(ERegister::Rdi, 8), correct_register);
+				program.Emit(EOpcode::Syscall);
 			}
 		}
 		else
 		{
 			if (tokens.size() == 2)
 			{
-				output_file << " mov rsp, rbp\n";
-				output_file << " pop rbp\n";
-				output_file << " ret\n";
+				program.Emit(EOpcode::Ret);
 			}
 			else
 			{
@@ -1246,13 +1981,24 @@ void Compiler::HandleReturnKeyword(const std::vector<Token>& tokens, std::ofstre
 				}
 				else
 				{
-					const std::string correct_register = GetCorrectVariableMathematicsRegisterGrade1(m_pCurrentFunction->return_size);
-					HandleComplexAssignment(std::vector<Token>(tokens.begin() + 1, tokens.end() - 1), output_file,
-						correct_register, m_pCurrentFunction->return_size, GetAssignmentType(m_pCurrentFunction->return_type));
+					const Operand correct_register = GetCorrectVariableMathematicsRegisterGrade1(m_pCurrentFunction->return_size);
+					if (arhi::IsCallExpression(tokens, 1, tokens.size() - 1))
+					{
+						// Nothing but the call in front of the ret, so TailCallOptimizer can turn the pair into a jump
+						const int32 function_result_size = HandleFunctionCall(std::vector<Token>(tokens.begin() + 1, tokens.end()), program);
+						const Operand function_result_register = GetCorrectVariableMathematicsRegisterGrade1(function_result_size);
+						if (function_result_size != 0 && function_result_register != correct_register)
+						{
+							Move(program, correct_register, function_result_register, m_pCurrentFunction->return_size, function_result_size);
+						}
+					}
+					else
+					{
+						HandleComplexAssignment(std::vector<Token>(tokens.begin() + 1, tokens.end() - 1), program,
+							correct_register, m_pCurrentFunction->return_size, GetAssignmentType(m_pCurrentFunction->return_type));
+					}
 
-					output_file << " mov rsp, rbp\n";
-					output_file << " pop rbp\n";
-					output_file << " ret\n";
+					program.Emit(EOpcode::Ret);
 				}
 			}
 		}
@@ -1263,54 +2009,42 @@ void Compiler::HandleReturnKeyword(const std::vector<Token>& tokens, std::ofstre
 	}
 }
 
-bool Compiler::HandleComplexAssignment(const std::vector<Token>& tokens, std::ofstream& output_file, const std::string& expected_result_location, const int32 result_size, const EAssignmentType assignment_type)
+bool Compiler::HandleComplexAssignment(const std::vector<Token>& tokens, MachineProgram& program, const Operand& expected_result_location, const int32 result_size, const EAssignmentType assignment_type)
 {
 	if (assignment_type == EAssignmentType::Integer || assignment_type == EAssignmentType::NotSpecified)
 	{
 		if (tokens.size() == 1)
 		{
-			std::string read_from = {};
 			if (tokens[0].type == ETokenType::Numeric)
 			{
-				read_from = tokens[0].value;
+				const Operand number = GetNumericOperand(tokens[0]);
+				if (number.empty()) return false;
 
-				if (expected_result_location != read_from)
+				// mov only stores 32 bit immediates, wider ones go through a register
+				if (expected_result_location.IsMemory() && (number.value < INT32_MIN || number.value > INT32_MAX))
 				{
-					const int32 max_size = arhi::clamp(4, 0, (int32)expected_result_location.size());
-					const bool is_pointer = expected_result_location.substr(0, max_size) == "qwor" ||
-						expected_result_location.substr(0, max_size) == "dwor" ||
-						expected_result_location.substr(0, max_size) == "word" ||
-						expected_result_location.substr(0, max_size) == "byte";
-
-					if (!is_pointer)
-					{
-						const std::string value = GetAssemblyTypesizeSpecifier(result_size);
-						output_file << " mov " << value << " " << expected_result_location << ", " << read_from << "\n";
-					}
-					else 
-					{
-						output_file << " mov " << expected_result_location << ", " << read_from << "\n";
-					}
+					const Operand correct_register = GetCorrectVariableMathematicsRegisterGrade1(result_size);
+					program.Emit(EOpcode::Mov, correct_register, number);
+					program.Emit(EOpcode::Mov, expected_result_location.WithSize(static_cast<uint8>(result_size), true), correct_register);
+					return true;
 				}
 
+				// Storing an immediate needs an explicit access size
+				program.Emit(EOpcode::Mov, expected_result_location.WithSize(static_cast<uint8>(result_size), true), number);
+
 				return true;
 			}
 			else if (tokens[0].type == ETokenType::Name)
 			{
-				const std::string correct_register = GetCorrectVariableMathematicsRegisterGrade1(result_size);
-				const std::string correct_assembly_specifier = GetAssemblyTypesizeSpecifier(result_size);
+				const Operand correct_register = GetCorrectVariableMathematicsRegisterGrade1(result_size);
 
-				const Variable variable = GetLocalVariableReference(tokens[0].value);
-				if (!IsCorrectVariableName(tokens[0].value, variable.variable_name)) return false;
-				read_from = variable.variable_assembly_safe + "]";
+				const Variable& variable = GetLocalVariableReference(tokens[0].symbol);
+				if (!IsCorrectVariableName(tokens[0].value, variable.symbol)) return false;
 
-				if (correct_register != read_from)
-				{
-					Move(output_file, correct_register, read_from, result_size, variable.type_size);
-				}
+				Move(program, correct_register, GetVariableOperand(variable, variable.type_size), result_size, variable.type_size);
 				if (expected_result_location != correct_register)
 				{
-					output_file << " mov " << correct_assembly_specifier << " " << expected_result_location << ", " << correct_register << "\n";
+					program.Emit(EOpcode::Mov, expected_result_location.WithSize(static_cast<uint8>(result_size), true), correct_register);
 				}
 
 				return true;
@@ -1362,8 +2096,8 @@ bool Compiler::HandleComplexAssignment(const std::vector<Token>& tokens, std::of
 				{
 					if (left.size() == 1)
 					{
-						const Variable variable = GetLocalVariableReference(left[0].value);
-						if (!IsCorrectVariableName(left[0].value, variable.variable_name)) return false;
+						const Variable& variable = GetLocalVariableReference(left[0].symbol);
+						if (!IsCorrectVariableName(left[0].value, variable.symbol)) return false;
 						if (IsBoolean(variable))
 						{
 							right.push_back(Token(ETokenType::Keyword, "true", left[0].line));
@@ -1373,36 +2107,35 @@ bool Compiler::HandleComplexAssignment(const std::vector<Token>& tokens, std::of
 				}
 
 				const int32 size = arhi::clamp(result_size, 4, 8);
-				const std::string correct_register = GetCorrectVariableMathematicsRegisterGrade1(size);
-				Compare(left, right, output_file);
-				MoveByCondition(ifworth, elseworth, condition, correct_register, size, output_file);
+				const Operand correct_register = GetCorrectVariableMathematicsRegisterGrade1(size);
+				MoveByCondition(left, right, ifworth, elseworth, condition, correct_register, size, program);
 
-				const std::string final_register = GetCorrectVariableMathematicsRegisterGrade1(result_size);
-				output_file << " mov " << expected_result_location << ", " << final_register << "\n";
+				const Operand final_register = GetCorrectVariableMathematicsRegisterGrade1(result_size);
+				program.Emit(EOpcode::Mov, expected_result_location, final_register);
 
 				return true;
 			}
 			else
 			{
-				const std::string correct_register = GetCorrectVariableMathematicsRegisterGrade1(result_size);
-				if (GetMathematicResultIntoRegister(tokens, result_size, output_file) != "")
+				const Operand correct_register = GetCorrectVariableMathematicsRegisterGrade1(result_size);
+				if (!GetMathematicResultIntoRegister(tokens, result_size, program).empty())
 				{
 					if (expected_result_location != correct_register)
 					{
-						output_file << " mov " << expected_result_location << ", " << correct_register << "\n";
+						program.Emit(EOpcode::Mov, expected_result_location, correct_register);
 			
 						return true;
 					}
 				}
 				else
 				{
-					const int32 function_result_size = HandleFunctionCall(tokens, output_file);
+					const int32 function_result_size = HandleFunctionCall(tokens, program);
 					if (function_result_size != 0)
 					{
-						const std::string function_result_register = GetCorrectVariableMathematicsRegisterGrade1(function_result_size);
+						const Operand function_result_register = GetCorrectVariableMathematicsRegisterGrade1(function_result_size);
 						if (function_result_register != expected_result_location)
 						{
-							Move(output_file, expected_result_location, function_result_register, result_size, function_result_size);
+							Move(program, expected_result_location, function_result_register, result_size, function_result_size);
 						}
 
 						return true;
@@ -1413,27 +2146,27 @@ bool Compiler::HandleComplexAssignment(const std::vector<Token>& tokens, std::of
 	}
 	if (assignment_type == EAssignmentType::Boolean || assignment_type == EAssignmentType::NotSpecified)
 	{
-		HandleComplexBooleanAssignment(tokens, output_file, expected_result_location, result_size);
+		HandleComplexBooleanAssignment(tokens, program, expected_result_location, result_size);
 	}
 
 	return false;
 }
 
-bool Compiler::HandleComplexBooleanAssignment(const std::vector<Token>& tokens, std::ofstream& output_file, const std::string& expected_result_location, const int32 result_size)
+bool Compiler::HandleComplexBooleanAssignment(const std::vector<Token>& tokens, MachineProgram& program, const Operand& expected_result_location, const int32 result_size)
 {
 	if (tokens.size() == 1)
 	{
-		const std::string correct_register = GetCorrectVariableMathematicsRegisterGrade1(result_size);
+		const Operand correct_register = GetCorrectVariableMathematicsRegisterGrade1(result_size);
 
 		if (tokens[0].type == ETokenType::Keyword)
 		{
 			if (tokens[0].value == "true")
 			{
-				output_file << " mov " << expected_result_location << ", 1\n";
+				program.Emit(EOpcode::Mov, expected_result_location, Operand::Immediate(1));
 			}
 			else if (tokens[0].value == "false")
 			{
-				output_file << " mov " << expected_result_location << ", 0\n";
+				program.Emit(EOpcode::Mov, expected_result_location, Operand::Immediate(0));
 			}
 			else
 			{
@@ -1443,12 +2176,12 @@ bool Compiler::HandleComplexBooleanAssignment(const std::vector<Token>& tokens,
 		}
 		else if (tokens[0].type == ETokenType::Name)
 		{
-			const Variable variable = GetLocalVariableReference(tokens[0].value);
-			if (!IsCorrectVariableName(tokens[0].value, variable.variable_name)) return false;
+			const Variable& variable = GetLocalVariableReference(tokens[0].symbol);
+			if (!IsCorrectVariableName(tokens[0].value, variable.symbol)) return false;
 			if (variable.type == "bool" || variable.type == "boolean")
 			{
-				output_file << " mov " << correct_register << ", " << variable.variable_assembly_safe << "]\n";
-				output_file << " mov " << expected_result_location << ", " << correct_register << "\n";
+				program.Emit(EOpcode::Mov, correct_register, GetVariableOperand(variable, result_size));
+				program.Emit(EOpcode::Mov, expected_result_location, correct_register);
 			}
 			else
 			{
@@ -1483,8 +2216,8 @@ bool Compiler::HandleComplexBooleanAssignment(const std::vector<Token>& tokens,
 		{
 			if (left.size() == 1)
 			{
-				const Variable variable = GetLocalVariableReference(left[0].value);
-				if (!IsCorrectVariableName(left[0].value, variable.variable_name)) return false;
+				const Variable& variable = GetLocalVariableReference(left[0].symbol);
+				if (!IsCorrectVariableName(left[0].value, variable.symbol)) return false;
 				if (IsBoolean(variable))				
 				{
 					right.push_back(Token(ETokenType::Keyword, "true", left[0].line));
@@ -1499,9 +2232,10 @@ bool Compiler::HandleComplexBooleanAssignment(const std::vector<Token>& tokens,
 			return false;
 		}
 
-		Compare(left, right, output_file);
-		output_file << " set" << GetConditionCodeEnding(condition) << " al\n";
-		Move(output_file, expected_result_location, "al", result_size, 1);
+		Compare(left, right, program);
+		const Operand result_register = Operand::Register(ERegister::Rax, 1);
+		program.Emit(EOpcode::Setcc, result_register, {}, GetCondition(condition));
+		Move(program, expected_result_location, result_register, result_size, 1);
 	}
 
 	return true;
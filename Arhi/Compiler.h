@@ -6,92 +6,25 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <stack>
+#include <functional>
 #include "Types.h"
+#include "TokenStream.h"
 #include "Tokenizer.h"
-
-enum class ECompileErrorType : uint8;
-enum class EAssignmentType : uint8;
-struct Token;
-struct Variable;
-struct Function;
-
-class Compiler
-{
-public:
-	Compiler() = default;
-	~Compiler() = default;
-
-public:
-	int32 Compile(const std::vector<std::vector<Token>>& tokens);
-
-private:
-	void CompileToken(const std::vector<Token>& tokens, std::ofstream& output_file, bool& bUseExitCode);
-	void CreateStandardAssembly(std::ofstream& output_file);
-	void CreateStandardExitAssemblyCode(std::ofstream& output_file);
-	bool IsCorrectVariableName(const std::string& variable_name, const std::string& result) const;
-	bool IsCorrectFunctionName(const std::string& function_name, const std::string& result) const;
-	bool CheckTypeSize(const Variable& variablea, const Variable& variableb) const;
-
-	std::string GetMathematicResultIntoRegister(std::vector<Token> tokens, const int32 register_size, std::ofstream& output_file);
-	std::string PerformMathematicTask(const std::string& first_value, const std::string& second_value, const int32 register_size, const char operation, const bool b_first_operation, std::ofstream& output_file);
-	int32 Precedence(char op);
-
-	int32 GetVariableSize(const std::string& variable_type) const;
-
-	Variable GetLocalVariableReference(const std::string variable_name) const;
-	Function GetFunction(const std::string& function_name) const;
-
-	std::string GetCorrectVariableMathematicsRegisterGrade1(int32 variable_size) const;
-	std::string GetCorrectVariableMathematicsRegisterGrade2(int32 variable_size) const;
-	std::string GetCorrectVariableMathematicsRegisterGrade3(int32 variable_size) const;
-	std::string GetCorrectVariableMathematicsRegisterGrade4(int32 variable_size) const;
-	std::string GetParameterRegister(const uint32 parameter_num, const int32 parameter_size) const;
-
-	void Compare(const std::vector<Token>& left, const std::vector<Token>& right, std::ofstream& output_file);
-	bool IsBoolean(const std::string& variable_type) const;
-	bool IsBoolean(const Variable& variable_type) const;
-	bool IsComplexIfStatement(const std::vector<Token>& tokens) const;
-	EAssignmentType GetAssignmentType(const std::string& variable_type) const;
-
-	std::string TokenTypeToString(ETokenType type) const;
-	std::string GetAssemblyTypesizeSpecifier(const int32 size) const;
-
-	std::string GetConditionCodeEnding(const Token& condition) const;
-	void MoveByCondition(const std::vector<Token>& ifworth, const std::vector<Token>& elseworth, const Token& condition, const std::string& expected_location, const int32 result_size, std::ofstream& output_file);
-
-	void Move(std::ofstream& output_file, const std::string& destination, const std::string& source, const int32 destination_size, const int32 source_size);
-
-	void HandleNegateMacro(const std::vector<Token>& tokens, std::ofstream& output_file);
-	void HandleClampMacro(const std::vector<Token>& tokens, std::ofstream& output_file);
-	void HandleRepeatMacro(const std::vector<Token>& tokens, std::ofstream& output_file);
-	void HandleSwapMacro(const std::vector<Token>& tokens, std::ofstream& output_file);
-
-	void HandleMacros(const std::vector<Token>& tokens, std::ofstream& output_file, bool& bUseExitCode);
-	void HandleScope(const std::vector<Token>& tokens, std::ofstream& output_file);
-	bool HandleVariableChanges(const std::vector<Token>& tokens, std::ofstream& output_file);
-	void HandleVariableDecleration(const std::vector<Token>& tokens, std::ofstream& output_file);
-	void HandleVariableParameters(const std::vector<Variable>& parameters, std::ofstream& output_file);
-	void HandleFunctionDecleration(const std::vector<Token>& tokens, std::ofstream& output_file);
-	int32 HandleFunctionCall(const std::vector<Token>& tokens, std::ofstream& output_file);
-	void HandleReturnKeyword(const std::vector<Token>& tokens, std::ofstream& output_file);
-
-	bool HandleComplexAssignment(const std::vector<Token>& tokens, std::ofstream& output_file, const std::string& expected_result_location, const int32 result_size, EAssignmentType assignment_type);
-	bool HandleComplexBooleanAssignment(const std::vector<Token>& tokens, std::ofstream& output_file, const std::string& expected_result_location, const int32 result_size);
-
-	bool CheckforSymicolon(const Token& token_to_check);
-
-private:
-	int32 m_DataSectionIndex = 1;
-	int32 m_BssSectionIndex = 2;
-	std::vector<int32> m_CurrentStacksizes = {};
-	std::vector<std::vector<Variable>> m_LocalVariables = {};
-	std::vector<Function> m_Functions = {};
-	Function* m_pCurrentFunction = 0;
-	int32 m_RemainingFunctionScopes = 0;
-	int32 m_CurrentLine = 0;
-	int32 m_SectionNumber = 0;
-};
+#include "ScopedSymbolTable.h"
+#include "AssemblyEmitter.h"
+#include "MachineIR.h"
+#include "Peephole.h"
+#include "RegisterAllocator.h"
+#include "FrameLowering.h"
+#include "Inliner.h"
+#include "TailCallOptimizer.h"
+#include "DeadCodeElimination.h"
+#include "LoopInvariantCodeMotion.h"
+#include "ValueNumbering.h"
+#include "DeadStoreElimination.h"
+#include "PassManager.h"
 
 enum class ECompileErrorType : uint8
 {
@@ -110,8 +43,9 @@ enum class EAssignmentType : uint8
 
 struct Variable
 {
-	std::string variable_name = {};
-	std::string variable_assembly_safe = {};
+	uint32 symbol = INVALID_SYMBOL;
+	// Stack slot of the function the variable belongs to
+	uint32 stack_slot = 0;
 	std::string type = {};
 	uint32 type_size = 4;
 	bool bUnsigned = false;
@@ -120,9 +54,9 @@ struct Variable
 	bool bIsArray = false;
 
 	Variable() = default;
-	explicit Variable(const std::string& variable_name, const std::string& variable_assembly_safe, const std::string& type,
+	explicit Variable(const uint32 symbol, const uint32 stack_slot, const std::string& type,
 		uint32 type_size, bool bUnsigned, bool bChangable, bool is_boolean, bool bIsArray)
-		: variable_name(variable_name), variable_assembly_safe(variable_assembly_safe), type(type),
+		: symbol(symbol), stack_slot(stack_slot), type(type),
 		type_size(type_size), bUnsigned(bUnsigned), bChangable(bChangable), is_boolean(is_boolean), bIsArray(bIsArray)
 	{
 	}
@@ -131,18 +65,124 @@ struct Variable
 
 struct Function 
 {
-	std::string function_name = {};
+	uint32 symbol = INVALID_SYMBOL;
 	int32 return_size = {};
 	std::vector<Variable> function_parameters = {};
 	std::string return_type = {};
+	// Index of the function in the machine program, the target of calls
+	uint32 machine_function = 0;
 
 	explicit Function() = default;
-	explicit Function(const std::string& function_name, const int32 return_size,
+	explicit Function(const uint32 symbol, const int32 return_size,
 		const std::vector<Variable>& function_parameters, const std::string& return_type)
-		: function_name(function_name), return_size(return_size), function_parameters(function_parameters),
+		: symbol(symbol), return_size(return_size), function_parameters(function_parameters),
 		return_type(return_type)
 	{
 	}
 	~Function() = default;
 };
 
+class Compiler
+{
+public:
+	Compiler() = default;
+	~Compiler() = default;
+
+public:
+	// Names are resolved through the symbol table the tokens were interned into
+	int32 Compile(const TokenStream& tokens, SymbolTable& symbols);
+	// Pulls token lines from the tokenizer one statement at a time, so lexing and code generation
+	// run interleaved and the full token set never has to be held in memory
+	int32 Compile(Tokenizer& tokenizer);
+
+	// Optimization level and pass switches for the next Compile
+	void SetPassOptions(const PassOptions& options) { m_PassOptions = options; }
+
+private:
+	int32 CompileLines(const std::function<bool(std::vector<Token>&)>& next_line);
+	// The passes between code generation and the assembly text, in the order they run
+	void CreatePasses(PassManager& pass_manager) const;
+	void CompileToken(const std::vector<Token>& tokens, MachineProgram& program, bool& bUseExitCode);
+	void CreateStandardAssembly(AssemblyEmitter& emitter);
+	void CreateStandardExitAssemblyCode(MachineProgram& program);
+	bool IsCorrectVariableName(std::string_view variable_name, const uint32 symbol) const;
+	bool IsCorrectFunctionName(std::string_view function_name, const uint32 symbol) const;
+	bool CheckTypeSize(const Variable& variablea, const Variable& variableb) const;
+
+	Operand GetMathematicResultIntoRegister(std::vector<Token> tokens, const int32 register_size, MachineProgram& program);
+	Operand PerformMathematicTask(const Operand& first_value, const Operand& second_value, const int32 register_size, const char operation, const bool bUnsigned, RegisterMask busy_registers, MachineProgram& program);
+	// Quotient or remainder of the dividend register, through div/idiv or DivideByConstant
+	Operand PerformDivision(const Operand& dividend, const Operand& divisor, const uint8 size, const bool bModulo, const bool bUnsigned, RegisterMask busy_registers, MachineProgram& program);
+	// Shifts for powers of two and a multiplication with a magic number for the rest. Empty if only div/idiv can do it.
+	Operand DivideByConstant(const Operand& dividend, const int64 divisor, const uint8 size, const bool bModulo, const bool bUnsigned, RegisterMask& busy_registers, MachineProgram& program);
+	// DivideByConstant through the high half of a mul with the magic number, for 64 bit dividends and unsigned 32 bit ones
+	// divided by more than 2^31. Empty if no register is left for the dividend or the multiplier.
+	Operand DivideByConstant64(const Operand& dividend, const int64 divisor, const uint64 magnitude, const uint8 size, const bool bModulo, const bool bUnsigned, RegisterMask& busy_registers, MachineProgram& program);
+	// Result of an operation that needs no code: both sides are literals or one side is an identity (x + 0, x * 1, x * 0, x / 1).
+	// Empty if the operation has to be emitted.
+	Operand FoldMathematicTask(const Operand& first_value, const Operand& second_value, const int32 register_size, const char operation, const bool bUnsigned) const;
+	void LoadMathematicValue(MachineProgram& program, const Operand& destination, const Operand& value);
+	int32 Precedence(char op);
+
+	int32 GetVariableSize(std::string_view variable_type) const;
+
+	// Both return an empty entry with INVALID_SYMBOL when nothing is bound to the symbol
+	const Variable& GetLocalVariableReference(const uint32 symbol) const;
+	const Function& GetFunction(const uint32 symbol) const;
+
+	Operand GetCorrectVariableMathematicsRegisterGrade1(int32 variable_size) const;
+	Operand GetCorrectVariableMathematicsRegisterGrade2(int32 variable_size) const;
+	Operand GetCorrectVariableMathematicsRegisterGrade3(int32 variable_size) const;
+	Operand GetCorrectVariableMathematicsRegisterGrade4(int32 variable_size) const;
+	Operand GetParameterRegister(const uint32 parameter_num, const int32 parameter_size) const;
+	Operand GetVariableOperand(const Variable& variable, const int32 access_size, const bool bPrintSize = false) const;
+	Operand GetNumericOperand(const Token& token) const;
+
+	void Compare(const std::vector<Token>& left, const std::vector<Token>& right, MachineProgram& program);
+	bool IsBoolean(std::string_view variable_type) const;
+	bool IsBoolean(const Variable& variable_type) const;
+	bool IsComplexIfStatement(const std::vector<Token>& tokens) const;
+	EAssignmentType GetAssignmentType(std::string_view variable_type) const;
+
+	std::string TokenTypeToString(ETokenType type) const;
+
+	ECondition GetCondition(const Token& condition) const;
+	void MoveByCondition(const std::vector<Token>& left, const std::vector<Token>& right, const std::vector<Token>& ifworth, const std::vector<Token>& elseworth, const Token& condition, const Operand& expected_location, const int32 result_size, MachineProgram& program);
+
+	void Move(MachineProgram& program, const Operand& destination, const Operand& source, const int32 destination_size, const int32 source_size);
+
+	void HandleNegateMacro(const std::vector<Token>& tokens, MachineProgram& program);
+	void HandleClampMacro(const std::vector<Token>& tokens, MachineProgram& program);
+	void HandleRepeatMacro(const std::vector<Token>& tokens, MachineProgram& program);
+	void HandleSwapMacro(const std::vector<Token>& tokens, MachineProgram& program);
+
+	void HandleMacros(const std::vector<Token>& tokens, MachineProgram& program, bool& bUseExitCode);
+	void HandleScope(const std::vector<Token>& tokens, MachineProgram& program);
+	bool HandleVariableChanges(const std::vector<Token>& tokens, MachineProgram& program);
+	void HandleVariableDecleration(const std::vector<Token>& tokens, MachineProgram& program);
+	void HandleVariableParameters(const std::vector<Variable>& parameters, MachineProgram& program);
+	void HandleFunctionDecleration(const std::vector<Token>& tokens, MachineProgram& program);
+	int32 HandleFunctionCall(const std::vector<Token>& tokens, MachineProgram& program);
+	void HandleReturnKeyword(const std::vector<Token>& tokens, MachineProgram& program);
+
+	bool HandleComplexAssignment(const std::vector<Token>& tokens, MachineProgram& program, const Operand& expected_result_location, const int32 result_size, EAssignmentType assignment_type);
+	bool HandleComplexBooleanAssignment(const std::vector<Token>& tokens, MachineProgram& program, const Operand& expected_result_location, const int32 result_size);
+
+	bool CheckforSymicolon(const Token& token_to_check);
+
+private:
+	SymbolTable* m_pSymbols = nullptr;
+	uint32 m_MainSymbol = INVALID_SYMBOL;
+
+	int32 m_DataSectionIndex = 1;
+	int32 m_BssSectionIndex = 2;
+	ScopedSymbolTable<Variable> m_LocalVariables = {};
+	ScopedSymbolTable<Function> m_Functions = {};
+	Function* m_pCurrentFunction = 0;
+	int32 m_RemainingFunctionScopes = 0;
+	// Parameter registers already loaded for the call whose arguments are being evaluated
+	RegisterMask m_LiveArgumentRegisters = 0;
+	int32 m_CurrentLine = 0;
+	int32 m_SectionNumber = 0;
+	PassOptions m_PassOptions = {};
+};
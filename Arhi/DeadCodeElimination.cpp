@@ -0,0 +1,136 @@
+#include "DeadCodeElimination.h"
+
+namespace
+{
+    // Index of the syscall that ends the program, instructions.size() when the block has none
+    size_t FindExit(const std::vector<Instruction>& instructions)
+    {
+        for (size_t index = 0; index < instructions.size(); index++)
+        {
+            if (arhi::IsExitSystemCall(instructions, index)) return index;
+        }
+
+        return instructions.size();
+    }
+}
+
+void DeadCodeElimination::Run(MachineProgram& program)
+{
+    m_RemovedFunctionCount = 0;
+    m_RemovedBlockCount = 0;
+
+    std::vector<MachineFunction>& functions = program.GetFunctions();
+    m_ReachableFunctions.assign(functions.size(), false);
+
+    // Code in front of the first function has no name to be called by, it runs like the entry point
+    m_PendingFunctions.clear();
+    for (size_t function_index = 0; function_index < functions.size(); function_index++)
+    {
+        if (functions[function_index].bEntryPoint || functions[function_index].name.empty()) m_PendingFunctions.push_back(function_index);
+    }
+
+    while (!m_PendingFunctions.empty())
+    {
+        const size_t function_index = m_PendingFunctions.back();
+        m_PendingFunctions.pop_back();
+        if (m_ReachableFunctions[function_index]) continue;
+
+        m_ReachableFunctions[function_index] = true;
+        FindReachableBlocks(functions, function_index);
+        RemoveUnreachableBlocks(functions[function_index]);
+    }
+
+    RemoveUnreachableFunctions(functions);
+}
+
+void DeadCodeElimination::FindReachableBlocks(const std::vector<MachineFunction>& functions, const size_t function_index)
+{
+    const std::vector<BasicBlock>& blocks = functions[function_index].blocks;
+    m_ReachableBlocks.assign(blocks.size(), false);
+    m_PendingBlocks.assign(1, 0);
+
+    while (!m_PendingBlocks.empty())
+    {
+        const size_t block_index = m_PendingBlocks.back();
+        m_PendingBlocks.pop_back();
+        if (m_ReachableBlocks[block_index]) continue;
+
+        m_ReachableBlocks[block_index] = true;
+        const std::vector<Instruction>& instructions = blocks[block_index].instructions;
+        const size_t exit_index = FindExit(instructions);
+        for (size_t index = 0; index < exit_index; index++)
+        {
+            const Operand& target = instructions[index].destination;
+            if (target.type == EOperandType::Function) m_PendingFunctions.push_back(static_cast<size_t>(target.value));
+            else if (instructions[index].IsBranch() && target.type == EOperandType::Label) m_PendingBlocks.push_back(static_cast<size_t>(target.value));
+        }
+
+        if (exit_index < instructions.size() || (!instructions.empty() && instructions.back().IsTerminator())) continue;
+
+        // The last block of a function that does not end in ret or exit runs into the text of the next function
+        if (block_index + 1 < blocks.size()) m_PendingBlocks.push_back(block_index + 1);
+        else if (function_index + 1 < functions.size()) m_PendingFunctions.push_back(function_index + 1);
+    }
+}
+
+void DeadCodeElimination::RemoveUnreachableBlocks(MachineFunction& function)
+{
+    std::vector<BasicBlock>& blocks = function.blocks;
+    std::vector<size_t> new_indices(blocks.size(), 0);
+
+    size_t block_count = 0;
+    for (size_t block_index = 0; block_index < blocks.size(); block_index++)
+    {
+        if (!m_ReachableBlocks[block_index]) continue;
+
+        std::vector<Instruction>& instructions = blocks[block_index].instructions;
+        const size_t exit_index = FindExit(instructions);
+        if (exit_index < instructions.size()) instructions.resize(exit_index + 1);
+
+        new_indices[block_index] = block_count;
+        if (block_index != block_count) blocks[block_count] = std::move(blocks[block_index]);
+        block_count++;
+    }
+
+    m_RemovedBlockCount += blocks.size() - block_count;
+    blocks.resize(block_count);
+
+    for (BasicBlock& block : blocks)
+    {
+        for (Instruction& instruction : block.instructions)
+        {
+            Operand& target = instruction.destination;
+            if (target.type == EOperandType::Label) target.value = static_cast<int64>(new_indices[static_cast<size_t>(target.value)]);
+        }
+    }
+}
+
+void DeadCodeElimination::RemoveUnreachableFunctions(std::vector<MachineFunction>& functions)
+{
+    std::vector<size_t> new_indices(functions.size(), 0);
+
+    size_t function_count = 0;
+    for (size_t function_index = 0; function_index < functions.size(); function_index++)
+    {
+        if (!m_ReachableFunctions[function_index]) continue;
+
+        new_indices[function_index] = function_count;
+        if (function_index != function_count) functions[function_count] = std::move(functions[function_index]);
+        function_count++;
+    }
+
+    m_RemovedFunctionCount = functions.size() - function_count;
+    functions.resize(function_count);
+
+    for (MachineFunction& function : functions)
+    {
+        for (BasicBlock& block : function.blocks)
+        {
+            for (Instruction& instruction : block.instructions)
+            {
+                Operand& callee = instruction.destination;
+                if (callee.type == EOperandType::Function) callee.value = static_cast<int64>(new_indices[static_cast<size_t>(callee.value)]);
+            }
+        }
+    }
+}
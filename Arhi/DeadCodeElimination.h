@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Types.h"
+#include "MachineIR.h"
+#include <vector>
+
+// Drops code the program can never run. Functions are kept when the entry point reaches them through calls
+// and tail calls, every other function is removed together with its text. Inside the kept functions a block
+// survives when control can get to it from the entry block by branches and falling through, which removes the
+// statements behind a return or an exit! and the copies the inliner left behind.
+class DeadCodeElimination
+{
+public:
+	DeadCodeElimination() = default;
+	~DeadCodeElimination() = default;
+
+	void Run(MachineProgram& program);
+
+	size_t GetRemovedFunctionCount() const { return m_RemovedFunctionCount; }
+	size_t GetRemovedBlockCount() const { return m_RemovedBlockCount; }
+
+private:
+	// Marks the blocks reachable from the entry block and queues the functions they call
+	void FindReachableBlocks(const std::vector<MachineFunction>& functions, const size_t function_index);
+	// Removes the unmarked blocks and everything behind an exit, branches get the new block indices
+	void RemoveUnreachableBlocks(MachineFunction& function);
+	void RemoveUnreachableFunctions(std::vector<MachineFunction>& functions);
+
+private:
+	std::vector<bool> m_ReachableFunctions = {};
+	std::vector<bool> m_ReachableBlocks = {};
+	std::vector<size_t> m_PendingFunctions = {};
+	std::vector<size_t> m_PendingBlocks = {};
+
+	size_t m_RemovedFunctionCount = 0;
+	size_t m_RemovedBlockCount = 0;
+};
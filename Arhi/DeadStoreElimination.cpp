@@ -0,0 +1,66 @@
+#include "DeadStoreElimination.h"
+#include "Liveness.h"
+
+namespace
+{
+    // Instructions whose only effects are the memory destination and the flags
+    bool IsRemovableStore(const Instruction& instruction)
+    {
+        const bool bPure = instruction.opcode == EOpcode::Mov || instruction.opcode == EOpcode::Setcc || instruction.IsArithmetic();
+        return bPure && instruction.destination.IsStackSlot();
+    }
+}
+
+void DeadStoreElimination::Run(MachineProgram& program)
+{
+    m_RemovedStoreCount = 0;
+
+    for (MachineFunction& function : program.GetFunctions())
+    {
+        if (function.stack_slot_sizes.empty()) continue;
+
+        // A removed add or inc was a read of the slot in front of it, without it more stores may be dead
+        m_bRemovedRead = true;
+        while (m_bRemovedRead)
+        {
+            m_bRemovedRead = false;
+
+            std::vector<std::vector<bool>> live_out_slots = arhi::ComputeLiveOutSlots(function);
+            for (size_t block_index = 0; block_index < function.blocks.size(); block_index++)
+            {
+                m_RemovedStoreCount += RemoveDeadStores(function.blocks[block_index], function.stack_slot_sizes, live_out_slots[block_index]);
+            }
+        }
+    }
+}
+
+size_t DeadStoreElimination::RemoveDeadStores(BasicBlock& block, const std::vector<uint8>& slot_sizes, std::vector<bool>& live_slots)
+{
+    std::vector<Instruction>& instructions = block.instructions;
+    m_Dead.assign(instructions.size(), false);
+    for (size_t index = instructions.size(); index > 0; index--)
+    {
+        const Instruction& instruction = instructions[index - 1];
+        const bool bStoresToSlot = instruction.destination.IsStackSlot() && instruction.WritesMemory();
+        const size_t destination_slot = bStoresToSlot ? static_cast<size_t>(instruction.destination.value) : SIZE_MAX;
+
+        m_Dead[index - 1] = bStoresToSlot && IsRemovableStore(instruction) && !live_slots[destination_slot]
+            && !(instruction.WritesFlags() && arhi::AreFlagsReadBeforeWrite(instructions, index));
+        if (m_Dead[index - 1])
+        {
+            if (instruction.ReadsDestination()) m_bRemovedRead = true;
+            continue;
+        }
+
+        if (instruction.destination.IsStackSlot())
+        {
+            // Only a plain write of the whole slot ends its value, cmp, push and narrower writes need what is there
+            const size_t slot_index = static_cast<size_t>(instruction.destination.value);
+            const bool bOverwrites = bStoresToSlot && !instruction.ReadsDestination() && instruction.destination.size >= slot_sizes[slot_index];
+            live_slots[slot_index] = !bOverwrites;
+        }
+        if (instruction.source.IsStackSlot()) live_slots[static_cast<size_t>(instruction.source.value)] = true;
+    }
+
+    return arhi::EraseMarked(instructions, m_Dead);
+}
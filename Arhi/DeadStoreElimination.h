@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Types.h"
+#include "MachineIR.h"
+#include <vector>
+
+// Removes stores into stack slots that are overwritten or never read again. Every local and parameter gets
+// its slot written when it is declared, so initializers of variables the function assigns before it reads
+// them and parameters it never reads leave stores behind. Liveness of the slots over the basic blocks tells
+// which ones are dead: a mov into a dead slot goes away, and so does an arithmetic instruction or a setcc
+// working on one as long as nothing reads the flags it sets.
+class DeadStoreElimination
+{
+public:
+	DeadStoreElimination() = default;
+	~DeadStoreElimination() = default;
+
+	void Run(MachineProgram& program);
+
+	size_t GetRemovedStoreCount() const { return m_RemovedStoreCount; }
+
+private:
+	// Returns the number of stores removed from the block, 'live_slots' holds the slots read behind it
+	size_t RemoveDeadStores(BasicBlock& block, const std::vector<uint8>& slot_sizes, std::vector<bool>& live_slots);
+
+private:
+	// Instructions of the block RemoveDeadStores leaves out
+	std::vector<bool> m_Dead = {};
+	// Set when a removed instruction read the slot it wrote, liveness has to be computed again then
+	bool m_bRemovedRead = false;
+
+	size_t m_RemovedStoreCount = 0;
+};
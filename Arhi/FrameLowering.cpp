@@ -0,0 +1,178 @@
+#include "FrameLowering.h"
+#include <algorithm>
+
+namespace
+{
+    constexpr uint32 RED_ZONE_SIZE = 128;
+    constexpr uint32 STACK_ALIGNMENT = 16;
+
+    // Saved in the order they are listed here and restored in reverse
+    constexpr ERegister CALLEE_SAVED_REGISTERS[] = {
+        ERegister::Rbx, ERegister::R12, ERegister::R13, ERegister::R14, ERegister::R15
+    };
+
+    uint32 AlignUp(const uint32 value, const uint32 alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+void FrameLowering::Run(MachineProgram& program)
+{
+    m_RedZoneFunctionCount = 0;
+    m_SharedSlotCount = 0;
+
+    for (MachineFunction& function : program.GetFunctions())
+    {
+        LowerFunction(function);
+    }
+}
+
+uint32 FrameLowering::AssignSlotOffsets(const MachineFunction& function)
+{
+    const size_t slot_count = function.stack_slot_sizes.size();
+    m_SlotOffsets.assign(slot_count, 0);
+    m_Cells.clear();
+
+    // Slots the register allocator took over have no accesses left and need no memory
+    std::vector<uint8> slot_sizes(slot_count, 0);
+    for (const BasicBlock& block : function.blocks)
+    {
+        for (const Instruction& instruction : block.instructions)
+        {
+            for (const Operand* operand : { &instruction.destination, &instruction.source })
+            {
+                if (!operand->IsStackSlot()) continue;
+
+                const size_t slot_index = static_cast<size_t>(operand->value);
+                slot_sizes[slot_index] = std::max({ slot_sizes[slot_index], operand->size, function.stack_slot_sizes[slot_index] });
+            }
+        }
+    }
+
+    const std::vector<LiveInterval> intervals = arhi::ComputeStackSlotIntervals(function);
+
+    std::vector<size_t> slots = {};
+    for (size_t slot_index = 0; slot_index < slot_count; slot_index++)
+    {
+        if (slot_sizes[slot_index] > 0) slots.push_back(slot_index);
+    }
+    std::sort(slots.begin(), slots.end(), [&](const size_t first, const size_t second)
+    {
+        if (slot_sizes[first] != slot_sizes[second]) return slot_sizes[first] > slot_sizes[second];
+        return intervals[first].start < intervals[second].start;
+    });
+
+    uint32 frame_size = 0;
+    for (const size_t slot_index : slots)
+    {
+        const uint8 size = slot_sizes[slot_index];
+        const LiveInterval& interval = intervals[slot_index];
+
+        // Slots of a size are visited by start, so a cell is free once everything in it has ended
+        const auto cell = std::find_if(m_Cells.begin(), m_Cells.end(), [size, &interval](const FrameCell& cell)
+        {
+            return cell.size == size && !interval.empty() && cell.end < interval.start;
+        });
+        if (cell != m_Cells.end())
+        {
+            cell->end = interval.end;
+            m_SlotOffsets[slot_index] = cell->offset;
+            m_SharedSlotCount++;
+            continue;
+        }
+
+        FrameCell new_cell = {};
+        new_cell.size = size;
+        new_cell.offset = AlignUp(frame_size, std::min<uint32>(size, 8)) + size;
+        new_cell.end = interval.empty() ? 0 : interval.end;
+        frame_size = new_cell.offset;
+
+        m_SlotOffsets[slot_index] = new_cell.offset;
+        m_Cells.push_back(new_cell);
+    }
+
+    return frame_size;
+}
+
+void FrameLowering::LowerFunction(MachineFunction& function)
+{
+    if (function.blocks.empty()) return;
+
+    const uint32 local_size = AssignSlotOffsets(function);
+
+    bool bReturns = false;
+    bool bCalls = false;
+    bool bMovesStackPointer = false;
+    RegisterMask written_registers = 0;
+    for (const BasicBlock& block : function.blocks)
+    {
+        for (const Instruction& instruction : block.instructions)
+        {
+            if (instruction.opcode == EOpcode::Ret || instruction.IsTailCall()) bReturns = true;
+            if (instruction.opcode == EOpcode::Call) bCalls = true;
+            else if (instruction.opcode != EOpcode::Ret && (instruction.GetDefinedRegisters() & GetRegisterBit(ERegister::Rsp))) bMovesStackPointer = true;
+
+            // Callees save what they write themselves
+            if (instruction.opcode != EOpcode::Call) written_registers |= instruction.GetDefinedRegisters();
+        }
+    }
+
+    // Functions without ret or tail call never hand control back (_start leaves through the exit syscall)
+    std::vector<ERegister> saved_registers = {};
+    for (const ERegister reg : CALLEE_SAVED_REGISTERS)
+    {
+        if (bReturns && (written_registers & GetRegisterBit(reg))) saved_registers.push_back(reg);
+    }
+
+    // Nothing below rsp survives a call or a push, everything else may keep its locals in the red zone
+    const bool bUseRedZone = !bCalls && !bMovesStackPointer && local_size <= RED_ZONE_SIZE;
+    const ERegister frame_base = bUseRedZone ? ERegister::Rsp : ERegister::Rbp;
+    if (bUseRedZone) m_RedZoneFunctionCount++;
+
+    for (BasicBlock& block : function.blocks)
+    {
+        for (Instruction& instruction : block.instructions)
+        {
+            for (Operand* operand : { &instruction.destination, &instruction.source })
+            {
+                if (!operand->IsStackSlot()) continue;
+
+                const uint32 offset = m_SlotOffsets[static_cast<size_t>(operand->value)];
+                *operand = Operand::Memory(frame_base, -static_cast<int64>(offset), operand->size, operand->bPrintSize);
+            }
+        }
+    }
+
+    const Operand frame_pointer = Operand::Register(ERegister::Rbp, 8);
+    const Operand stack_pointer = Operand::Register(ERegister::Rsp, 8);
+
+    std::vector<Instruction> prologue = {};
+    std::vector<Instruction> epilogue = {};
+    // The operating system enters with rsp 16 byte aligned already, so an entry point without locals needs no frame
+    const bool bNeedsFrame = !bUseRedZone && !(function.bEntryPoint && local_size == 0 && saved_registers.empty());
+    for (const ERegister reg : saved_registers) prologue.push_back(Instruction(EOpcode::Push, Operand::Register(reg, 8)));
+    if (bNeedsFrame)
+    {
+        // rsp has to be 16 byte aligned at every call: the return address, the saved registers and rbp are on the stack already
+        const uint32 pushed_size = (function.bEntryPoint ? 0 : 8) + static_cast<uint32>(saved_registers.size() + 1) * 8;
+        const uint32 frame_size = AlignUp(local_size + pushed_size, STACK_ALIGNMENT) - pushed_size;
+
+        prologue.push_back(Instruction(EOpcode::Push, frame_pointer));
+        prologue.push_back(Instruction(EOpcode::Mov, frame_pointer, stack_pointer));
+        if (frame_size > 0) prologue.push_back(Instruction(EOpcode::Sub, stack_pointer, Operand::Immediate(frame_size)));
+
+        epilogue.push_back(Instruction(EOpcode::Mov, stack_pointer, frame_pointer));
+        epilogue.push_back(Instruction(EOpcode::Pop, frame_pointer));
+    }
+    for (auto reg = saved_registers.rbegin(); reg != saved_registers.rend(); ++reg) epilogue.push_back(Instruction(EOpcode::Pop, Operand::Register(*reg, 8)));
+
+    std::vector<Instruction>& entry = function.blocks[0].instructions;
+    entry.insert(entry.begin(), prologue.begin(), prologue.end());
+
+    for (BasicBlock& block : function.blocks)
+    {
+        if (block.instructions.empty() || (block.instructions.back().opcode != EOpcode::Ret && !block.instructions.back().IsTailCall())) continue;
+        block.instructions.insert(block.instructions.end() - 1, epilogue.begin(), epilogue.end());
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Types.h"
+#include "MachineIR.h"
+#include "Liveness.h"
+#include <vector>
+
+// Lays out the stack frame of every function once code generation and register allocation are done. The
+// stack slots that are still in memory get naturally aligned offsets, largest first so nothing needs
+// padding, and slots whose live intervals do not overlap share the same bytes. Each function gets one
+// prologue and one epilogue in front of every ret and tail call, with the frame size rounded so calls
+// see a 16 byte aligned stack. Leaf functions whose locals fit into the 128 byte red zone below rsp skip the frame,
+// and so does an entry point without locals.
+class FrameLowering
+{
+public:
+	FrameLowering() = default;
+	~FrameLowering() = default;
+
+	void Run(MachineProgram& program);
+
+	size_t GetRedZoneFunctionCount() const { return m_RedZoneFunctionCount; }
+	size_t GetSharedSlotCount() const { return m_SharedSlotCount; }
+
+private:
+	// Fills m_SlotOffsets (distance below the frame base) and returns the size of the local area
+	uint32 AssignSlotOffsets(const MachineFunction& function);
+	void LowerFunction(MachineFunction& function);
+
+private:
+	struct FrameCell
+	{
+		uint32 offset = 0;
+		uint8 size = 0;
+		// Last position any slot in this cell is live at
+		size_t end = 0;
+	};
+
+	std::vector<uint32> m_SlotOffsets = {};
+	std::vector<FrameCell> m_Cells = {};
+
+	size_t m_RedZoneFunctionCount = 0;
+	size_t m_SharedSlotCount = 0;
+};
@@ -0,0 +1,248 @@
+#include "Inliner.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace
+{
+    // Instructions a function may have to be copied into its callers without a hint. Neither the ret nor the
+    // stores of the parameters count, the copy does without them.
+    constexpr size_t INLINE_INSTRUCTION_LIMIT = 32;
+
+    bool IsParameterStore(const Instruction& instruction)
+    {
+        return instruction.opcode == EOpcode::Mov && instruction.destination.IsStackSlot() && instruction.source.IsRegister()
+            && (GetRegisterBit(instruction.source.reg) & ARGUMENT_REGISTERS) != 0;
+    }
+
+    // Whether any block reads the register before writing it, apart from the skipped instruction
+    bool IsReadBeforeWrite(const std::vector<BasicBlock>& blocks, const ERegister reg, const Instruction* skipped)
+    {
+        const RegisterMask register_bit = GetRegisterBit(reg);
+        for (const BasicBlock& block : blocks)
+        {
+            for (const Instruction& instruction : block.instructions)
+            {
+                if (&instruction == skipped) continue;
+                if (instruction.GetUsedRegisters() & register_bit) return true;
+                if (instruction.GetDefinedRegisters() & register_bit) break;
+            }
+        }
+        return false;
+    }
+
+    bool TargetsBlock(const Instruction& instruction, const size_t block_index)
+    {
+        return instruction.IsBranch() && instruction.destination.type == EOperandType::Label && static_cast<size_t>(instruction.destination.value) == block_index;
+    }
+}
+
+size_t Inliner::Run(MachineProgram& program)
+{
+    std::vector<MachineFunction>& functions = program.GetFunctions();
+    m_InlinedCallCount = 0;
+    FindRecursiveFunctions(functions);
+
+    for (size_t caller_index = 0; caller_index < functions.size(); caller_index++)
+    {
+        MachineFunction& caller = functions[caller_index];
+
+        // The copied blocks are visited as well, calls the callee kept get the same decision again
+        for (size_t block_index = 0; block_index < caller.blocks.size(); block_index++)
+        {
+            const std::vector<Instruction>& instructions = caller.blocks[block_index].instructions;
+            for (size_t index = 0; index < instructions.size(); index++)
+            {
+                if (instructions[index].opcode != EOpcode::Call) continue;
+
+                const size_t callee_index = static_cast<size_t>(instructions[index].destination.value);
+                if (callee_index == caller_index || m_Recursive[callee_index]) continue;
+                if (!ShouldInline(caller.blocks[block_index], index, functions[callee_index])) continue;
+
+                // Everything behind the call moved into a block after the copy
+                InlineCall(caller, block_index, index, functions[callee_index]);
+                break;
+            }
+        }
+    }
+
+    return m_InlinedCallCount;
+}
+
+void Inliner::FindRecursiveFunctions(const std::vector<MachineFunction>& functions)
+{
+    std::vector<std::vector<size_t>> callees(functions.size());
+    for (size_t function_index = 0; function_index < functions.size(); function_index++)
+    {
+        for (const BasicBlock& block : functions[function_index].blocks)
+        {
+            for (const Instruction& instruction : block.instructions)
+            {
+                if (instruction.opcode == EOpcode::Call) callees[function_index].push_back(static_cast<size_t>(instruction.destination.value));
+            }
+        }
+    }
+
+    // A function is recursive when it can reach itself through its callees
+    m_Recursive.assign(functions.size(), false);
+    std::vector<bool> visited = {};
+    std::vector<size_t> pending = {};
+    for (size_t function_index = 0; function_index < functions.size(); function_index++)
+    {
+        visited.assign(functions.size(), false);
+        pending = callees[function_index];
+        while (!pending.empty() && !m_Recursive[function_index])
+        {
+            const size_t callee_index = pending.back();
+            pending.pop_back();
+            if (visited[callee_index]) continue;
+
+            visited[callee_index] = true;
+            m_Recursive[function_index] = callee_index == function_index;
+            pending.insert(pending.end(), callees[callee_index].begin(), callees[callee_index].end());
+        }
+    }
+}
+
+bool Inliner::ShouldInline(const BasicBlock& block, const size_t call_index, const MachineFunction& callee) const
+{
+    if (callee.bEntryPoint || callee.blocks.empty() || callee.inline_hint == EInlineHint::Never) return false;
+
+    size_t instruction_count = 0;
+    RegisterMask written_registers = 0;
+    for (const BasicBlock& callee_block : callee.blocks)
+    {
+        for (const Instruction& instruction : callee_block.instructions)
+        {
+            // The entry block continues the block of the call, nothing may jump to it. A tail call would leave the caller.
+            if (TargetsBlock(instruction, 0) || instruction.IsTailCall()) return false;
+
+            if (instruction.opcode == EOpcode::Ret) continue;
+
+            if (!IsParameterStore(instruction)) instruction_count++;
+            written_registers |= instruction.GetDefinedRegisters();
+        }
+    }
+    if (callee.inline_hint != EInlineHint::Always && instruction_count > INLINE_INSTRUCTION_LIMIT) return false;
+
+    // The callee saves the registers a call has to keep, the copy does not. None of them may be read after the call.
+    RegisterMask kept_registers = written_registers & ~block.instructions[call_index].GetDefinedRegisters();
+    for (size_t index = call_index + 1; index < block.instructions.size() && kept_registers != 0; index++)
+    {
+        const Instruction& instruction = block.instructions[index];
+        if (instruction.GetUsedRegisters() & kept_registers) return false;
+        kept_registers &= ~instruction.GetDefinedRegisters();
+    }
+
+    return true;
+}
+
+void Inliner::InlineCall(MachineFunction& caller, const size_t block_index, const size_t call_index, const MachineFunction& callee)
+{
+    const std::string prefix = "INLINE" + std::to_string(m_InlinedCallCount++) + "_";
+    const int64 first_slot = static_cast<int64>(caller.stack_slot_sizes.size());
+    caller.stack_slot_sizes.insert(caller.stack_slot_sizes.end(), callee.stack_slot_sizes.begin(), callee.stack_slot_sizes.end());
+
+    // The callee blocks take the places from block_index on, its entry block is merged into the block of the call
+    const size_t callee_block_count = callee.blocks.size();
+    const size_t return_block_index = block_index + callee_block_count;
+    for (BasicBlock& block : caller.blocks)
+    {
+        for (Instruction& instruction : block.instructions)
+        {
+            if (instruction.destination.type == EOperandType::Label && static_cast<size_t>(instruction.destination.value) > block_index)
+            {
+                instruction.destination.value += static_cast<int64>(callee_block_count);
+            }
+        }
+    }
+
+    BasicBlock return_block = {};
+    std::vector<Instruction>& call_block = caller.blocks[block_index].instructions;
+    return_block.instructions.assign(call_block.begin() + static_cast<std::ptrdiff_t>(call_index) + 1, call_block.end());
+    call_block.erase(call_block.begin() + static_cast<std::ptrdiff_t>(call_index), call_block.end());
+
+    // Code behind a ret that no branch reaches, like the one closing the function after a return, is left out
+    std::vector<BasicBlock> copies = callee.blocks;
+    bool bReachable = true;
+    for (BasicBlock& copy : copies)
+    {
+        if (!copy.label.empty()) bReachable = true;
+        if (!bReachable) copy.instructions.clear();
+        if (!copy.instructions.empty()) bReachable = !copy.instructions.back().IsTerminator();
+    }
+
+    size_t last_copy_index = copies.size() - 1;
+    while (last_copy_index > 0 && copies[last_copy_index].instructions.empty()) last_copy_index--;
+
+    for (size_t copy_index = 0; copy_index < copies.size(); copy_index++)
+    {
+        BasicBlock& copy = copies[copy_index];
+        if (!copy.label.empty()) copy.label = prefix + copy.label;
+
+        for (Instruction& instruction : copy.instructions)
+        {
+            for (Operand* operand : { &instruction.destination, &instruction.source })
+            {
+                if (operand->IsStackSlot()) operand->value += first_slot;
+                else if (operand->type == EOperandType::Label) operand->value += static_cast<int64>(block_index);
+            }
+        }
+
+        // The last ret simply falls through, the others jump behind the copy
+        std::vector<Instruction>& instructions = copy.instructions;
+        if (instructions.empty() || instructions.back().opcode != EOpcode::Ret) continue;
+        if (copy_index == last_copy_index)
+        {
+            instructions.pop_back();
+            continue;
+        }
+        instructions.back() = Instruction(EOpcode::Jmp, Operand::Label(static_cast<uint32>(return_block_index)));
+        return_block.label = prefix + "RETURN";
+    }
+
+    BindArguments(caller.blocks[block_index], copies);
+    call_block.insert(call_block.end(), copies[0].instructions.begin(), copies[0].instructions.end());
+
+    // A copy that ends in a jump reaches the code behind the call only through a label
+    if (!copies.back().instructions.empty() && copies.back().instructions.back().IsTerminator()) return_block.label = prefix + "RETURN";
+
+    std::vector<BasicBlock>::iterator position = caller.blocks.begin() + static_cast<std::ptrdiff_t>(block_index) + 1;
+    position = caller.blocks.insert(position, copies.begin() + 1, copies.end());
+    caller.blocks.insert(position + static_cast<std::ptrdiff_t>(copies.size() - 1), std::move(return_block));
+}
+
+void Inliner::BindArguments(BasicBlock& block, std::vector<BasicBlock>& copies) const
+{
+    std::vector<Instruction>& instructions = block.instructions;
+    std::vector<Instruction>& entry = copies[0].instructions;
+
+    size_t entry_index = 0;
+    while (entry_index < entry.size() && IsParameterStore(entry[entry_index]))
+    {
+        const Instruction& store = entry[entry_index];
+        const RegisterMask argument_bit = GetRegisterBit(store.source.reg);
+
+        // The last write of the argument register before the call, which nothing may have read since
+        size_t index = instructions.size();
+        bool bRead = false;
+        while (index > 0 && !(instructions[index - 1].GetDefinedRegisters() & argument_bit))
+        {
+            bRead |= (instructions[index - 1].GetUsedRegisters() & argument_bit) != 0;
+            index--;
+        }
+
+        Instruction* argument = index > 0 && !bRead ? &instructions[index - 1] : nullptr;
+        const bool bBindable = argument != nullptr && !IsReadBeforeWrite(copies, store.source.reg, &store)
+            && argument->opcode == EOpcode::Mov && argument->destination == store.source
+            && ((argument->source.IsRegister() && argument->source.reg != store.source.reg)
+                || (argument->source.IsImmediate() && (store.source.size < 8 || (argument->source.value >= INT32_MIN && argument->source.value <= INT32_MAX))));
+        if (!bBindable)
+        {
+            entry_index++;
+            continue;
+        }
+
+        *argument = Instruction(EOpcode::Mov, store.destination.WithSize(store.destination.size, true), argument->source.WithSize(argument->source.size, false));
+        entry.erase(entry.begin() + static_cast<std::ptrdiff_t>(entry_index));
+    }
+}
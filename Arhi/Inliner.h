@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Types.h"
+#include "MachineIR.h"
+#include <vector>
+
+// Replaces calls of small functions with a copy of their body. A function is copied when it is not recursive
+// and is small enough (INLINE_INSTRUCTION_LIMIT), or when it was declared with "define inline"; "define
+// noinline" keeps every call. The copy gets stack slots of its own in the caller, the arguments are written
+// straight into the slots of the parameters and every ret becomes a jump behind the copied code.
+class Inliner
+{
+public:
+	Inliner() = default;
+	~Inliner() = default;
+
+	// Functions come before their callers in the program, so callees are expanded first. Returns the number of inlined calls.
+	size_t Run(MachineProgram& program);
+
+private:
+	void FindRecursiveFunctions(const std::vector<MachineFunction>& functions);
+	bool ShouldInline(const BasicBlock& block, const size_t call_index, const MachineFunction& callee) const;
+	void InlineCall(MachineFunction& caller, const size_t block_index, const size_t call_index, const MachineFunction& callee);
+	// Turns "mov edi, x / .. / call" and the "mov [parameter], edi" at the start of the copy into "mov [parameter], x"
+	// when the copy reads edi nowhere else
+	void BindArguments(BasicBlock& block, std::vector<BasicBlock>& copies) const;
+
+private:
+	std::vector<bool> m_Recursive = {};
+	size_t m_InlinedCallCount = 0;
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "Types.h"
+#include "TokenStream.h"
+#include <array>
+#include <string_view>
+
+// Compile-time lookup tables for the tokenizer. Reserved words and operators live in perfect hash
+// tables whose seed is searched by the compiler, so classifying a word costs one hash and one compare.
+// Single characters are classified through a 256 entry bit table instead of building strings.
+namespace arhi
+{
+	enum ECharClass : uint8
+	{
+		Space = 1 << 0,
+		Alpha = 1 << 1,
+		Digit = 1 << 2,
+		IdentifierStart = 1 << 3,
+		OperatorSymbol = 1 << 4,
+		BooleanOperatorSymbol = 1 << 5,
+		IdentifierStop = 1 << 6
+	};
+
+	constexpr std::array<uint8, 256> BuildCharClasses()
+	{
+		std::array<uint8, 256> classes = {};
+
+		for (const char c : std::string_view(" \t\n\v\f\r")) classes[static_cast<uint8>(c)] |= Space | IdentifierStop;
+		for (int32 c = 'a'; c <= 'z'; c++) classes[c] |= Alpha | IdentifierStart;
+		for (int32 c = 'A'; c <= 'Z'; c++) classes[c] |= Alpha | IdentifierStart;
+		for (int32 c = '0'; c <= '9'; c++) classes[c] |= Digit;
+		classes['_'] |= IdentifierStart;
+
+		for (const char c : std::string_view("+-*/%,")) classes[static_cast<uint8>(c)] |= OperatorSymbol | IdentifierStop;
+		for (const char c : std::string_view("?<>")) classes[static_cast<uint8>(c)] |= BooleanOperatorSymbol;
+		for (const char c : std::string_view(":();[]")) classes[static_cast<uint8>(c)] |= IdentifierStop;
+
+		return classes;
+	}
+
+	constexpr std::array<uint8, 256> gCharClasses = BuildCharClasses();
+
+	constexpr bool HasCharClass(const char c, const uint8 char_class)
+	{
+		return (gCharClasses[static_cast<uint8>(c)] & char_class) != 0;
+	}
+
+	struct LexiconEntry
+	{
+		std::string_view word = {};
+		ETokenType type = ETokenType::Unkown;
+	};
+
+	constexpr uint32 HashWord(std::string_view word, const uint32 seed)
+	{
+		uint32 hash = seed;
+		for (const char c : word)
+		{
+			hash = (hash ^ static_cast<uint8>(c)) * 16777619u;
+		}
+
+		return hash ^ (hash >> 16);
+	}
+
+	template <size_t EntryCount, size_t TableSize>
+	class PerfectHashTable
+	{
+		static_assert((TableSize & (TableSize - 1)) == 0, "The table size has to be a power of two");
+		static_assert(EntryCount <= TableSize, "The table is too small for its entries");
+
+	public:
+		constexpr explicit PerfectHashTable(const std::array<LexiconEntry, EntryCount>& entries)
+			: m_Seed(FindSeed(entries)), m_Slots()
+		{
+			for (const LexiconEntry& entry : entries)
+			{
+				m_Slots[HashWord(entry.word, m_Seed) & (TableSize - 1)] = entry;
+			}
+		}
+
+		constexpr bool IsValid() const { return m_Seed != 0; }
+
+		constexpr ETokenType Find(std::string_view word) const
+		{
+			const LexiconEntry& slot = m_Slots[HashWord(word, m_Seed) & (TableSize - 1)];
+			return slot.word == word ? slot.type : ETokenType::Unkown;
+		}
+
+	private:
+		static constexpr uint32 FindSeed(const std::array<LexiconEntry, EntryCount>& entries)
+		{
+			for (uint32 seed = 2166136261u; seed != 2166136261u + 4096; seed++)
+			{
+				std::array<bool, TableSize> used_slots = {};
+				bool bCollides = false;
+
+				for (const LexiconEntry& entry : entries)
+				{
+					const uint32 slot = HashWord(entry.word, seed) & (TableSize - 1);
+					if (used_slots[slot])
+					{
+						bCollides = true;
+						break;
+					}
+					used_slots[slot] = true;
+				}
+
+				if (!bCollides) return seed;
+			}
+
+			return 0;
+		}
+
+	private:
+		uint32 m_Seed = 0;
+		std::array<LexiconEntry, TableSize> m_Slots;
+	};
+
+	constexpr std::array<LexiconEntry, 26> gIdentifierEntries = { {
+		{ "bool", ETokenType::Variable }, { "boolean", ETokenType::Variable }, { "byte", ETokenType::Variable },
+		{ "int8", ETokenType::Variable }, { "uint8", ETokenType::Variable }, { "int16", ETokenType::Variable },
+		{ "uint16", ETokenType::Variable }, { "int32", ETokenType::Variable }, { "uint32", ETokenType::Variable },
+		{ "int64", ETokenType::Variable }, { "uint64", ETokenType::Variable }, { "void", ETokenType::Variable },
+		{ "exit!", ETokenType::Macro }, { "negate!", ETokenType::Macro }, { "clamp!", ETokenType::Macro },
+		{ "repeat!", ETokenType::Macro }, { "swap!", ETokenType::Macro },
+		{ "global", ETokenType::Keyword }, { "local", ETokenType::Keyword }, { "if", ETokenType::Keyword },
+		{ "define", ETokenType::Keyword }, { "return", ETokenType::Keyword }, { "true", ETokenType::Keyword },
+		{ "false", ETokenType::Keyword }, { "inline", ETokenType::Keyword }, { "noinline", ETokenType::Keyword }
+	} };
+
+	constexpr std::array<LexiconEntry, 9> gOperatorEntries = { {
+		{ "++", ETokenType::Operator }, { "--", ETokenType::Operator }, { "->", ETokenType::Operator },
+		{ "+", ETokenType::Operator }, { "-", ETokenType::Operator }, { "*", ETokenType::Operator },
+		{ "/", ETokenType::Operator }, { "%", ETokenType::Operator }, { ",", ETokenType::Operator }
+	} };
+
+	constexpr std::array<LexiconEntry, 7> gBooleanOperatorEntries = { {
+		{ "?", ETokenType::BooleanOperator }, { "<=", ETokenType::BooleanOperator }, { "<", ETokenType::BooleanOperator },
+		{ ">=", ETokenType::BooleanOperator }, { ">", ETokenType::BooleanOperator }, { "==", ETokenType::BooleanOperator },
+		{ "!=", ETokenType::BooleanOperator }
+	} };
+
+	constexpr PerfectHashTable<26, 64> gIdentifierTable = PerfectHashTable<26, 64>(gIdentifierEntries);
+	constexpr PerfectHashTable<9, 16> gOperatorTable = PerfectHashTable<9, 16>(gOperatorEntries);
+	constexpr PerfectHashTable<7, 16> gBooleanOperatorTable = PerfectHashTable<7, 16>(gBooleanOperatorEntries);
+
+	static_assert(gIdentifierTable.IsValid(), "No collision free seed found for the identifier table");
+	static_assert(gOperatorTable.IsValid(), "No collision free seed found for the operator table");
+	static_assert(gBooleanOperatorTable.IsValid(), "No collision free seed found for the boolean operator table");
+}
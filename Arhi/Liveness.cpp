@@ -0,0 +1,249 @@
+#include "Liveness.h"
+#include <algorithm>
+
+namespace
+{
+    constexpr uint64 LOOP_WEIGHT_FACTOR = 8;
+    constexpr size_t MAX_LOOP_WEIGHT_DEPTH = 6;
+
+    struct BitSet
+    {
+        std::vector<uint64> words = {};
+
+        explicit BitSet(size_t bit_count = 0) : words((bit_count + 63) / 64, 0) {}
+
+        void Set(size_t bit) { words[bit / 64] |= 1ull << (bit % 64); }
+        bool Test(size_t bit) const { return (words[bit / 64] >> (bit % 64)) & 1ull; }
+    };
+
+    size_t GetStackSlot(const Operand& operand)
+    {
+        return operand.IsStackSlot() ? static_cast<size_t>(operand.value) : SIZE_MAX;
+    }
+
+    // The system call number and the exit code, the other argument registers mean nothing to exit
+    constexpr RegisterMask EXIT_REGISTERS = GetRegisterBit(ERegister::Rax) | GetRegisterBit(ERegister::Rdi);
+
+    // Blocks control may go to from each block: the next one unless the block ends in a terminator, and the target of its branch
+    std::vector<std::vector<size_t>> ComputeSuccessors(const MachineFunction& function)
+    {
+        const size_t block_count = function.blocks.size();
+        std::vector<std::vector<size_t>> successors(block_count);
+        for (size_t block_index = 0; block_index < block_count; block_index++)
+        {
+            const std::vector<Instruction>& instructions = function.blocks[block_index].instructions;
+            if (block_index + 1 < block_count && (instructions.empty() || !instructions.back().IsTerminator()))
+            {
+                successors[block_index].push_back(block_index + 1);
+            }
+            if (instructions.empty() || !instructions.back().IsBranch() || instructions.back().destination.type != EOperandType::Label) continue;
+
+            successors[block_index].push_back(static_cast<size_t>(instructions.back().destination.value));
+        }
+
+        return successors;
+    }
+
+    struct SlotLiveness
+    {
+        std::vector<size_t> block_starts = {};
+        std::vector<size_t> loop_depths = {};
+        std::vector<BitSet> live_in = {};
+        std::vector<BitSet> live_out = {};
+    };
+
+    SlotLiveness ComputeSlotLiveness(const MachineFunction& function)
+    {
+        const size_t block_count = function.blocks.size();
+        const size_t slot_count = function.stack_slot_sizes.size();
+        SlotLiveness liveness = SlotLiveness();
+
+        std::vector<size_t>& block_starts = liveness.block_starts;
+        block_starts.assign(block_count + 1, 0);
+        for (size_t block_index = 0; block_index < block_count; block_index++)
+        {
+            block_starts[block_index + 1] = block_starts[block_index] + function.blocks[block_index].instructions.size();
+        }
+
+        // Every backward branch closes a loop over the blocks between its target and itself
+        std::vector<size_t>& loop_depths = liveness.loop_depths;
+        loop_depths.assign(block_count, 0);
+        const std::vector<std::vector<size_t>> successors = ComputeSuccessors(function);
+        for (size_t block_index = 0; block_index < block_count; block_index++)
+        {
+            for (const size_t target : successors[block_index])
+            {
+                if (target > block_index) continue;
+                for (size_t loop_block = target; loop_block <= block_index; loop_block++) loop_depths[loop_block]++;
+            }
+        }
+
+        // Upward exposed uses and definitions of every block
+        std::vector<BitSet> uses(block_count, BitSet(slot_count));
+        std::vector<BitSet> definitions(block_count, BitSet(slot_count));
+        for (size_t block_index = 0; block_index < block_count; block_index++)
+        {
+            for (const Instruction& instruction : function.blocks[block_index].instructions)
+            {
+                const size_t source_slot = GetStackSlot(instruction.source);
+                const size_t destination_slot = GetStackSlot(instruction.destination);
+
+                if (source_slot != SIZE_MAX && !definitions[block_index].Test(source_slot)) uses[block_index].Set(source_slot);
+                if (destination_slot != SIZE_MAX)
+                {
+                    if (instruction.ReadsDestination() && !definitions[block_index].Test(destination_slot)) uses[block_index].Set(destination_slot);
+                    // A narrower write keeps the rest of the slot
+                    const bool bWritesWholeSlot = instruction.destination.size >= function.stack_slot_sizes[destination_slot];
+                    if (instruction.WritesMemory() && bWritesWholeSlot) definitions[block_index].Set(destination_slot);
+                    else if (!definitions[block_index].Test(destination_slot)) uses[block_index].Set(destination_slot);
+                }
+            }
+        }
+
+        // live_in = uses | (live_out & ~definitions), iterated backwards until nothing changes
+        std::vector<BitSet>& live_in = liveness.live_in;
+        std::vector<BitSet>& live_out = liveness.live_out;
+        live_in.assign(block_count, BitSet(slot_count));
+        live_out.assign(block_count, BitSet(slot_count));
+        bool bChanged = true;
+        while (bChanged)
+        {
+            bChanged = false;
+            for (size_t block_index = block_count; block_index-- > 0;)
+            {
+                BitSet& out = live_out[block_index];
+                for (const size_t successor : successors[block_index])
+                {
+                    for (size_t word = 0; word < out.words.size(); word++) out.words[word] |= live_in[successor].words[word];
+                }
+
+                BitSet& in = live_in[block_index];
+                for (size_t word = 0; word < in.words.size(); word++)
+                {
+                    const uint64 new_word = uses[block_index].words[word] | (out.words[word] & ~definitions[block_index].words[word]);
+                    if (new_word != in.words[word])
+                    {
+                        in.words[word] = new_word;
+                        bChanged = true;
+                    }
+                }
+            }
+        }
+
+        return liveness;
+    }
+}
+
+std::vector<LiveInterval> arhi::ComputeStackSlotIntervals(const MachineFunction& function)
+{
+    const size_t block_count = function.blocks.size();
+    const size_t slot_count = function.stack_slot_sizes.size();
+    std::vector<LiveInterval> intervals(slot_count);
+
+    const SlotLiveness liveness = ComputeSlotLiveness(function);
+    const std::vector<size_t>& block_starts = liveness.block_starts;
+
+    for (size_t block_index = 0; block_index < block_count; block_index++)
+    {
+        uint64 weight = 1;
+        for (size_t depth = 0; depth < std::min(liveness.loop_depths[block_index], MAX_LOOP_WEIGHT_DEPTH); depth++) weight *= LOOP_WEIGHT_FACTOR;
+
+        size_t position = block_starts[block_index];
+        for (const Instruction& instruction : function.blocks[block_index].instructions)
+        {
+            for (const size_t slot_index : { GetStackSlot(instruction.source), GetStackSlot(instruction.destination) })
+            {
+                if (slot_index == SIZE_MAX) continue;
+
+                LiveInterval& interval = intervals[slot_index];
+                interval.start = std::min(interval.start, position);
+                interval.end = std::max(interval.end, position);
+                interval.weight += weight;
+            }
+
+            position++;
+        }
+    }
+
+    for (size_t block_index = 0; block_index < block_count; block_index++)
+    {
+        if (block_starts[block_index] == block_starts[block_index + 1]) continue;
+
+        for (size_t slot_index = 0; slot_index < slot_count; slot_index++)
+        {
+            LiveInterval& interval = intervals[slot_index];
+            if (liveness.live_in[block_index].Test(slot_index)) interval.start = std::min(interval.start, block_starts[block_index]);
+            if (liveness.live_out[block_index].Test(slot_index)) interval.end = std::max(interval.end, block_starts[block_index + 1] - 1);
+        }
+    }
+
+    return intervals;
+}
+
+std::vector<std::vector<bool>> arhi::ComputeLiveOutSlots(const MachineFunction& function)
+{
+    const size_t slot_count = function.stack_slot_sizes.size();
+    const SlotLiveness liveness = ComputeSlotLiveness(function);
+
+    std::vector<std::vector<bool>> live_out_slots(function.blocks.size(), std::vector<bool>(slot_count, false));
+    for (size_t block_index = 0; block_index < function.blocks.size(); block_index++)
+    {
+        for (size_t slot_index = 0; slot_index < slot_count; slot_index++) live_out_slots[block_index][slot_index] = liveness.live_out[block_index].Test(slot_index);
+    }
+
+    return live_out_slots;
+}
+
+RegisterMask arhi::GetLiveRegistersBefore(const std::vector<Instruction>& instructions, const size_t index, const RegisterMask live_after)
+{
+    const Instruction& instruction = instructions[index];
+
+    // Behind a ret or a tail call only what it passes on is read, the callee saved registers are restored
+    if (instruction.opcode == EOpcode::Ret || instruction.IsTailCall()) return instruction.GetUsedRegisters();
+    // Nothing runs after an exit
+    if (arhi::IsExitSystemCall(instructions, index)) return EXIT_REGISTERS;
+
+    return (live_after & ~instruction.GetDefinedRegisters()) | instruction.GetUsedRegisters();
+}
+
+std::vector<RegisterMask> arhi::ComputeLiveOutRegisters(const MachineFunction& function)
+{
+    const size_t block_count = function.blocks.size();
+    const std::vector<std::vector<size_t>> successors = ComputeSuccessors(function);
+
+    // A block that leaves without a ret or a tail call and goes to no block of its own runs into code the function
+    // knows nothing about, every register may be read there
+    std::vector<RegisterMask> open_ends(block_count, 0);
+    for (size_t block_index = 0; block_index < block_count; block_index++)
+    {
+        const std::vector<Instruction>& instructions = function.blocks[block_index].instructions;
+        const bool bReturns = !instructions.empty() && (instructions.back().opcode == EOpcode::Ret || instructions.back().IsTailCall());
+        if (successors[block_index].empty() && !bReturns) open_ends[block_index] = ~0u;
+    }
+
+    // Same backward iteration as for the slots, registers fit in a single mask
+    std::vector<RegisterMask> live_in(block_count, 0);
+    std::vector<RegisterMask> live_out(block_count, 0);
+    bool bChanged = true;
+    while (bChanged)
+    {
+        bChanged = false;
+        for (size_t block_index = block_count; block_index-- > 0;)
+        {
+            RegisterMask live = open_ends[block_index];
+            for (const size_t successor : successors[block_index]) live |= live_in[successor];
+            live_out[block_index] = live;
+
+            const std::vector<Instruction>& instructions = function.blocks[block_index].instructions;
+            for (size_t index = instructions.size(); index-- > 0;) live = arhi::GetLiveRegistersBefore(instructions, index, live);
+
+            if (live != live_in[block_index])
+            {
+                live_in[block_index] = live;
+                bChanged = true;
+            }
+        }
+    }
+
+    return live_out;
+}
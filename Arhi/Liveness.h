@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Types.h"
+#include "MachineIR.h"
+#include <cstdint>
+#include <vector>
+
+// Range of instruction positions of a function (its blocks counted in order) in which a stack slot holds
+// a value that is still needed, both ends inclusive
+struct LiveInterval
+{
+	size_t start = SIZE_MAX;
+	size_t end = 0;
+	// Number of accesses, an access inside a loop counts LOOP_WEIGHT_FACTOR times per nesting level
+	uint64 weight = 0;
+
+	bool empty() const { return start == SIZE_MAX; }
+	bool Overlaps(const LiveInterval& other) const { return !empty() && !other.empty() && start <= other.end && other.start <= end; }
+};
+
+namespace arhi
+{
+	// Live intervals of all stack slots of a function, indexed like MachineFunction::stack_slot_sizes. A slot
+	// that is live across a block boundary covers the whole block on that side, so loops keep their slots alive.
+	std::vector<LiveInterval> ComputeStackSlotIntervals(const MachineFunction& function);
+	// Stack slots whose value may still be read when control leaves a block, indexed by block and then by slot
+	std::vector<std::vector<bool>> ComputeLiveOutSlots(const MachineFunction& function);
+	// Registers live in front of the instruction at index, given the ones live behind it
+	RegisterMask GetLiveRegistersBefore(const std::vector<Instruction>& instructions, const size_t index, const RegisterMask live_after);
+	// Registers whose value may still be read when control leaves a block, indexed by block
+	std::vector<RegisterMask> ComputeLiveOutRegisters(const MachineFunction& function);
+}
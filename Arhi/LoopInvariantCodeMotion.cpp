@@ -0,0 +1,239 @@
+#include "LoopInvariantCodeMotion.h"
+#include <algorithm>
+
+namespace
+{
+    // Location numbers after the registers
+    constexpr uint32 FLAGS_LOCATION = REGISTER_COUNT;
+    // Everything that is not a stack slot, calls may read and write any of it
+    constexpr uint32 MEMORY_LOCATION = REGISTER_COUNT + 1;
+    constexpr uint32 FIRST_SLOT_LOCATION = REGISTER_COUNT + 2;
+
+    // Instructions whose only effect is their destination operand (and the flags)
+    bool IsMovable(const Instruction& instruction)
+    {
+        const bool bComparison = instruction.opcode == EOpcode::Cmp || instruction.ReadsFlags();
+        return instruction.IsPure() && !bComparison && (instruction.destination.IsRegister() || instruction.destination.IsStackSlot());
+    }
+
+    void AddRegisters(std::vector<uint32>& locations, const RegisterMask registers)
+    {
+        for (uint32 reg = 0; reg < REGISTER_COUNT; reg++)
+        {
+            if (registers & (1u << reg)) locations.push_back(reg);
+        }
+    }
+}
+
+size_t LoopInvariantCodeMotion::Run(MachineProgram& program)
+{
+    size_t hoisted_count = 0;
+
+    for (MachineFunction& function : program.GetFunctions())
+    {
+        for (size_t block_index = 1; block_index < function.blocks.size(); block_index++)
+        {
+            if (!IsLoop(function, block_index)) continue;
+
+            const BasicBlock& block = function.blocks[block_index];
+            CollectLocations(function, block);
+            FindInvariantInstructions(block);
+
+            const size_t block_hoisted_count = static_cast<size_t>(std::count(m_Hoisted.begin(), m_Hoisted.end(), true));
+            if (block_hoisted_count == 0) continue;
+
+            // Hoisting may put a block in front of the loop, which moves the loop one further
+            const size_t block_count = function.blocks.size();
+            HoistInstructions(function, block_index);
+            hoisted_count += block_hoisted_count;
+            block_index += function.blocks.size() - block_count;
+        }
+    }
+
+    return hoisted_count;
+}
+
+bool LoopInvariantCodeMotion::IsLoop(const MachineFunction& function, const size_t block_index) const
+{
+    const BasicBlock& block = function.blocks[block_index];
+    if (block.instructions.empty()) return false;
+
+    const Instruction& back_edge = block.instructions.back();
+    if (!back_edge.IsBranch() || back_edge.destination.type != EOperandType::Label || static_cast<size_t>(back_edge.destination.value) != block_index) return false;
+
+    // Control has to come in from above, where the hoisted code runs
+    const std::vector<Instruction>& previous = function.blocks[block_index - 1].instructions;
+    if (!previous.empty() && previous.back().IsTerminator()) return false;
+
+    for (const BasicBlock& other : function.blocks)
+    {
+        for (const Instruction& instruction : other.instructions)
+        {
+            if (&instruction == &back_edge || !instruction.IsBranch()) continue;
+            if (instruction.destination.type == EOperandType::Label && static_cast<size_t>(instruction.destination.value) == block_index) return false;
+        }
+    }
+
+    return true;
+}
+
+void LoopInvariantCodeMotion::CollectLocations(const MachineFunction& function, const BasicBlock& block)
+{
+    m_Locations.assign(block.instructions.size(), Locations());
+
+    for (size_t index = 0; index < block.instructions.size(); index++)
+    {
+        const Instruction& instruction = block.instructions[index];
+        Locations& locations = m_Locations[index];
+
+        AddRegisters(locations.reads, instruction.GetUsedRegisters());
+        AddRegisters(locations.writes, instruction.GetDefinedRegisters());
+
+        if (instruction.ReadsFlags()) locations.reads.push_back(FLAGS_LOCATION);
+        if (instruction.WritesFlags()) locations.writes.push_back(FLAGS_LOCATION);
+
+        if (instruction.opcode == EOpcode::Call || instruction.opcode == EOpcode::Syscall)
+        {
+            locations.reads.push_back(MEMORY_LOCATION);
+            locations.writes.push_back(MEMORY_LOCATION);
+        }
+
+        for (const Operand* operand : { &instruction.destination, &instruction.source })
+        {
+            if (!operand->IsMemory() || instruction.opcode == EOpcode::Lea) continue;
+
+            const uint32 location = operand->IsStackSlot() ? FIRST_SLOT_LOCATION + static_cast<uint32>(operand->value) : MEMORY_LOCATION;
+            const bool bDestination = operand == &instruction.destination;
+            const bool bWrite = bDestination && instruction.WritesMemory();
+            // A store narrower than its slot keeps the rest of the old value
+            const bool bPartialWrite = bWrite && operand->IsStackSlot() && operand->size < function.stack_slot_sizes[static_cast<size_t>(operand->value)];
+
+            if (!bDestination || instruction.ReadsDestination() || bPartialWrite) locations.reads.push_back(location);
+            if (bWrite) locations.writes.push_back(location);
+        }
+    }
+}
+
+void LoopInvariantCodeMotion::FindInvariantInstructions(const BasicBlock& block)
+{
+    m_Hoisted.assign(block.instructions.size(), false);
+    for (size_t index = 0; index < block.instructions.size(); index++)
+    {
+        m_Hoisted[index] = IsMovable(block.instructions[index]);
+    }
+
+    bool bChanged = false;
+    do
+    {
+        bChanged = false;
+        for (size_t index = 0; index < block.instructions.size(); index++)
+        {
+            if (!m_Hoisted[index] || IsInvariant(index)) continue;
+
+            m_Hoisted[index] = false;
+            bChanged = true;
+        }
+    } while (bChanged);
+}
+
+bool LoopInvariantCodeMotion::IsInvariant(const size_t index) const
+{
+    const size_t instruction_count = m_Locations.size();
+
+    // Every value it reads is either set before the loop or by an earlier instruction that is hoisted as well
+    for (const uint32 location : m_Locations[index].reads)
+    {
+        size_t writer = index;
+        while (writer > 0 && !Writes(writer - 1, location)) writer--;
+
+        if (writer > 0)
+        {
+            if (!m_Hoisted[writer - 1]) return false;
+            continue;
+        }
+
+        // Nothing writes it before, so any later write reaches this read in the next iteration
+        for (size_t later = index; later < instruction_count; later++)
+        {
+            if (Writes(later, location)) return false;
+        }
+    }
+
+    for (const uint32 location : m_Locations[index].writes)
+    {
+        // The value from before the loop is read in its first iteration, it must not be replaced up front
+        size_t first_writer = 0;
+        while (!Writes(first_writer, location)) first_writer++;
+        for (size_t earlier = 0; earlier <= first_writer; earlier++)
+        {
+            if (Reads(earlier, location)) return false;
+        }
+
+        bool bReadInLoop = false;
+        bool bOverwritten = false;
+        for (size_t later = index + 1; later < instruction_count && !bOverwritten; later++)
+        {
+            bReadInLoop |= Reads(later, location) && !m_Hoisted[later];
+            bOverwritten = Writes(later, location);
+        }
+
+        // The last write of a location stays valid for the rest of the loop once every write of it is hoisted.
+        // Any other write is replaced by the next one before the loop reads it, so only hoisted code may read it.
+        if (bOverwritten)
+        {
+            if (bReadInLoop) return false;
+            continue;
+        }
+        for (size_t earlier = 0; earlier < index; earlier++)
+        {
+            if (Writes(earlier, location) && !m_Hoisted[earlier]) return false;
+        }
+    }
+
+    return true;
+}
+
+void LoopInvariantCodeMotion::HoistInstructions(MachineFunction& function, const size_t block_index)
+{
+    std::vector<Instruction> hoisted = {};
+    std::vector<Instruction> remaining = {};
+    const std::vector<Instruction>& instructions = function.blocks[block_index].instructions;
+    for (size_t index = 0; index < instructions.size(); index++)
+    {
+        (m_Hoisted[index] ? hoisted : remaining).push_back(instructions[index]);
+    }
+    function.blocks[block_index].instructions = std::move(remaining);
+
+    // A branch at the end of the block above would skip the hoisted code, it goes into a new block in between
+    const std::vector<Instruction>& previous = function.blocks[block_index - 1].instructions;
+    size_t preheader_index = block_index - 1;
+    if (!previous.empty() && previous.back().IsBranch())
+    {
+        function.blocks.insert(function.blocks.begin() + static_cast<std::ptrdiff_t>(block_index), BasicBlock());
+        preheader_index = block_index;
+
+        for (BasicBlock& block : function.blocks)
+        {
+            for (Instruction& instruction : block.instructions)
+            {
+                Operand& target = instruction.destination;
+                if (target.type == EOperandType::Label && static_cast<size_t>(target.value) >= block_index) target.value++;
+            }
+        }
+    }
+
+    std::vector<Instruction>& preheader = function.blocks[preheader_index].instructions;
+    preheader.insert(preheader.end(), hoisted.begin(), hoisted.end());
+}
+
+bool LoopInvariantCodeMotion::Reads(const size_t index, const uint32 location) const
+{
+    const std::vector<uint32>& reads = m_Locations[index].reads;
+    return std::find(reads.begin(), reads.end(), location) != reads.end();
+}
+
+bool LoopInvariantCodeMotion::Writes(const size_t index, const uint32 location) const
+{
+    const std::vector<uint32>& writes = m_Locations[index].writes;
+    return std::find(writes.begin(), writes.end(), location) != writes.end();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Types.h"
+#include "MachineIR.h"
+#include <vector>
+
+// Moves computations whose operands do not change inside a loop in front of it. Loops are the blocks that
+// branch back to their own label, like the ones repeat! produces. Such a block is only entered from the block
+// above it and always runs at least once, so an instruction can leave it when every value it reads is set up
+// before the loop or by another instruction that leaves, and everything that reads its result leaves as well.
+class LoopInvariantCodeMotion
+{
+public:
+	LoopInvariantCodeMotion() = default;
+	~LoopInvariantCodeMotion() = default;
+
+	// Returns the number of hoisted instructions
+	size_t Run(MachineProgram& program);
+
+private:
+	// Registers, the flags and stack slots, numbered so one index names any of them
+	struct Locations
+	{
+		std::vector<uint32> reads = {};
+		std::vector<uint32> writes = {};
+	};
+
+	bool IsLoop(const MachineFunction& function, const size_t block_index) const;
+	void CollectLocations(const MachineFunction& function, const BasicBlock& block);
+	// Starts with every instruction that may move at all and drops the ones that break a condition until none does
+	void FindInvariantInstructions(const BasicBlock& block);
+	bool IsInvariant(const size_t index) const;
+	// Puts the hoisted instructions into the block that falls into the loop, which is created when there is none
+	void HoistInstructions(MachineFunction& function, const size_t block_index);
+
+	bool Reads(const size_t index, const uint32 location) const;
+	bool Writes(const size_t index, const uint32 location) const;
+
+private:
+	std::vector<Locations> m_Locations = {};
+	std::vector<bool> m_Hoisted = {};
+};
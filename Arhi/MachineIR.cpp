@@ -0,0 +1,536 @@
+#include "MachineIR.h"
+#include <array>
+#include <cstdint>
+#include <utility>
+
+namespace
+{
+    using SizedNames = std::array<std::string_view, 4>;
+
+    // Register names per operand size (8, 4, 2 and 1 bytes), indexed by ERegister
+    constexpr SizedNames REGISTER_NAMES[] = {
+        { "rax", "eax", "ax", "al" }, { "rbx", "ebx", "bx", "bl" }, { "rcx", "ecx", "cx", "cl" }, { "rdx", "edx", "dx", "dl" },
+        { "rsi", "esi", "si", "sil" }, { "rdi", "edi", "di", "dil" }, { "rbp", "ebp", "bp", "bpl" }, { "rsp", "esp", "sp", "spl" },
+        { "r8", "r8d", "r8w", "r8b" }, { "r9", "r9d", "r9w", "r9b" }, { "r10", "r10d", "r10w", "r10b" }, { "r11", "r11d", "r11w", "r11b" },
+        { "r12", "r12d", "r12w", "r12b" }, { "r13", "r13d", "r13w", "r13b" }, { "r14", "r14d", "r14w", "r14b" }, { "r15", "r15d", "r15w", "r15b" }
+    };
+    constexpr SizedNames SIZE_SPECIFIERS = { "qword", "dword", "word", "byte" };
+
+    // Indexed by EOpcode, the condition suffix follows directly for cmovcc, setcc and jcc
+    constexpr std::string_view MNEMONICS[] = {
+        "mov", "movzx", "movsx", "movsxd", "lea", "add", "sub", "imul", "mul", "div", "idiv", "cdq", "cqo",
+        "inc", "dec", "neg", "and", "shl", "shr", "sar", "xchg", "cmp",
+        "cmov", "set", "jmp", "j", "push", "pop", "call", "ret", "syscall"
+    };
+    static_assert(sizeof(MNEMONICS) / sizeof(MNEMONICS[0]) == static_cast<size_t>(EOpcode::Syscall) + 1, "Every opcode needs a mnemonic");
+
+    constexpr std::string_view CONDITION_SUFFIXES[] = { "", "e", "ne", "g", "ge", "l", "le" };
+
+    constexpr RegisterMask STACK_POINTER = GetRegisterBit(ERegister::Rsp);
+    constexpr RegisterMask CALL_CLOBBERED_REGISTERS = ARGUMENT_REGISTERS | GetRegisterBit(ERegister::Rax)
+        | GetRegisterBit(ERegister::R10) | GetRegisterBit(ERegister::R11);
+    constexpr RegisterMask SYSCALL_ARGUMENT_REGISTERS = GetRegisterBit(ERegister::Rax) | GetRegisterBit(ERegister::Rdi) | GetRegisterBit(ERegister::Rsi)
+        | GetRegisterBit(ERegister::Rdx) | GetRegisterBit(ERegister::R10) | GetRegisterBit(ERegister::R8) | GetRegisterBit(ERegister::R9);
+    constexpr RegisterMask SYSCALL_CLOBBERED_REGISTERS = GetRegisterBit(ERegister::Rax) | GetRegisterBit(ERegister::Rcx) | GetRegisterBit(ERegister::R11);
+    constexpr int64 EXIT_SYSTEM_CALL = 60;
+
+    // Registers an operand reads when it is a source: the register itself or the base and index of a memory access
+    RegisterMask GetReadRegisters(const Operand& operand)
+    {
+        if (operand.IsMemory()) return GetRegisterBit(operand.reg) | GetRegisterBit(operand.index);
+        return operand.IsRegister() ? GetRegisterBit(operand.reg) : 0u;
+    }
+
+    // A destination operand reads the base of a memory access and the rest of a partially written register
+    RegisterMask GetDestinationReadRegisters(const Operand& operand)
+    {
+        if (operand.IsMemory()) return GetRegisterBit(operand.reg) | GetRegisterBit(operand.index);
+        if (operand.IsRegister() && operand.size < 4) return GetRegisterBit(operand.reg);
+        return 0u;
+    }
+
+    RegisterMask GetWrittenRegisters(const Operand& operand)
+    {
+        return operand.IsRegister() ? GetRegisterBit(operand.reg) : 0u;
+    }
+
+    constexpr std::string_view GetSizedName(const SizedNames& names, const uint8 size)
+    {
+        switch (size)
+        {
+            case 8: return names[0];
+            case 4: return names[1];
+            case 2: return names[2];
+            case 1: return names[3];
+            default: return {};
+        }
+    }
+}
+
+std::string_view arhi::GetRegisterName(const ERegister reg, const uint8 size)
+{
+    if (reg == ERegister::None) return {};
+    return GetSizedName(REGISTER_NAMES[static_cast<size_t>(reg)], size);
+}
+
+std::string_view arhi::GetSizeSpecifier(const uint8 size)
+{
+    return GetSizedName(SIZE_SPECIFIERS, size);
+}
+
+std::string_view arhi::GetConditionSuffix(const ECondition condition)
+{
+    return CONDITION_SUFFIXES[static_cast<size_t>(condition)];
+}
+
+int64 arhi::TruncateToSize(const int64 value, const uint8 size)
+{
+    switch (size)
+    {
+        case 1: return static_cast<int8_t>(value);
+        case 2: return static_cast<int16>(value);
+        case 4: return static_cast<int32>(value);
+        default: return value;
+    }
+}
+
+Operand Operand::Register(const ERegister reg, const uint8 size, const bool bPrintSize)
+{
+    Operand operand = {};
+    operand.type = EOperandType::Register;
+    operand.size = size;
+    operand.bPrintSize = bPrintSize;
+    operand.reg = reg;
+    return operand;
+}
+
+Operand Operand::Memory(const ERegister base, const int64 displacement, const uint8 size, const bool bPrintSize)
+{
+    Operand operand = {};
+    operand.type = EOperandType::Memory;
+    operand.size = size;
+    operand.bPrintSize = bPrintSize;
+    operand.reg = base;
+    operand.value = displacement;
+    return operand;
+}
+
+Operand Operand::Address(const ERegister base, const ERegister index, const uint8 scale, const int64 displacement)
+{
+    Operand operand = {};
+    operand.type = EOperandType::Memory;
+    operand.size = 8;
+    operand.reg = base;
+    operand.index = index;
+    operand.scale = scale;
+    operand.value = displacement;
+    return operand;
+}
+
+Operand Operand::StackSlot(const uint32 slot_index, const uint8 size, const bool bPrintSize)
+{
+    Operand operand = {};
+    operand.type = EOperandType::StackSlot;
+    operand.size = size;
+    operand.bPrintSize = bPrintSize;
+    operand.value = slot_index;
+    return operand;
+}
+
+Operand Operand::Immediate(const int64 value, const uint8 size)
+{
+    Operand operand = {};
+    operand.type = EOperandType::Immediate;
+    operand.size = size;
+    operand.value = value;
+    return operand;
+}
+
+Operand Operand::Label(const uint32 block_index)
+{
+    Operand operand = {};
+    operand.type = EOperandType::Label;
+    operand.value = block_index;
+    return operand;
+}
+
+Operand Operand::Function(const uint32 function_index)
+{
+    Operand operand = {};
+    operand.type = EOperandType::Function;
+    operand.value = function_index;
+    return operand;
+}
+
+Operand Operand::WithSize(const uint8 new_size, const bool bNewPrintSize) const
+{
+    Operand operand = *this;
+    operand.size = new_size;
+    operand.bPrintSize = bNewPrintSize;
+    return operand;
+}
+
+RegisterMask Instruction::GetUsedRegisters() const
+{
+    switch (opcode)
+    {
+    case EOpcode::Mov:
+    case EOpcode::Movzx:
+    case EOpcode::Movsx:
+    case EOpcode::Movsxd:
+    case EOpcode::Lea:
+    case EOpcode::Setcc:
+        return GetDestinationReadRegisters(destination) | GetReadRegisters(source);
+    case EOpcode::Add:
+    case EOpcode::Sub:
+    case EOpcode::Imul:
+    case EOpcode::Inc:
+    case EOpcode::Dec:
+    case EOpcode::Neg:
+    case EOpcode::And:
+    case EOpcode::Shl:
+    case EOpcode::Shr:
+    case EOpcode::Sar:
+    case EOpcode::Xchg:
+    case EOpcode::Cmp:
+    case EOpcode::Cmovcc:
+        return GetReadRegisters(destination) | GetReadRegisters(source);
+    case EOpcode::Mul:
+        return GetRegisterBit(ERegister::Rax) | GetReadRegisters(destination);
+    case EOpcode::Div:
+    case EOpcode::Idiv:
+        return GetRegisterBit(ERegister::Rax) | GetRegisterBit(ERegister::Rdx) | GetReadRegisters(destination);
+    case EOpcode::Cdq:
+    case EOpcode::Cqo:
+        return GetRegisterBit(ERegister::Rax);
+    case EOpcode::Push:
+        return GetReadRegisters(destination) | STACK_POINTER;
+    case EOpcode::Pop:
+        return GetDestinationReadRegisters(destination) | STACK_POINTER;
+    case EOpcode::Call:
+        return ARGUMENT_REGISTERS | STACK_POINTER;
+    case EOpcode::Ret:
+        return GetRegisterBit(ERegister::Rax) | STACK_POINTER;
+    case EOpcode::Jmp:
+        return IsTailCall() ? ARGUMENT_REGISTERS | STACK_POINTER : 0u;
+    case EOpcode::Syscall:
+        return SYSCALL_ARGUMENT_REGISTERS;
+    default:
+        return 0u;
+    }
+}
+
+RegisterMask Instruction::GetDefinedRegisters() const
+{
+    switch (opcode)
+    {
+    case EOpcode::Mov:
+    case EOpcode::Movzx:
+    case EOpcode::Movsx:
+    case EOpcode::Movsxd:
+    case EOpcode::Lea:
+    case EOpcode::Add:
+    case EOpcode::Sub:
+    case EOpcode::Imul:
+    case EOpcode::Inc:
+    case EOpcode::Dec:
+    case EOpcode::Neg:
+    case EOpcode::And:
+    case EOpcode::Shl:
+    case EOpcode::Shr:
+    case EOpcode::Sar:
+    case EOpcode::Cmovcc:
+    case EOpcode::Setcc:
+        return GetWrittenRegisters(destination);
+    case EOpcode::Xchg:
+        return GetWrittenRegisters(destination) | GetWrittenRegisters(source);
+    case EOpcode::Mul:
+    case EOpcode::Div:
+    case EOpcode::Idiv:
+        return GetRegisterBit(ERegister::Rax) | GetRegisterBit(ERegister::Rdx);
+    case EOpcode::Cdq:
+    case EOpcode::Cqo:
+        return GetRegisterBit(ERegister::Rdx);
+    case EOpcode::Pop:
+        return GetWrittenRegisters(destination) | STACK_POINTER;
+    case EOpcode::Push:
+    case EOpcode::Ret:
+        return STACK_POINTER;
+    case EOpcode::Call:
+        return CALL_CLOBBERED_REGISTERS;
+    case EOpcode::Syscall:
+        return SYSCALL_CLOBBERED_REGISTERS;
+    default:
+        return 0u;
+    }
+}
+
+bool Instruction::WritesMemory() const
+{
+    switch (opcode)
+    {
+    case EOpcode::Cmp:
+    case EOpcode::Push:
+    case EOpcode::Mul:
+    case EOpcode::Div:
+    case EOpcode::Idiv:
+    case EOpcode::Jmp:
+    case EOpcode::Jcc:
+    case EOpcode::Call:
+    case EOpcode::Ret:
+        return false;
+    case EOpcode::Xchg:
+        return destination.IsMemory() || source.IsMemory();
+    default:
+        return destination.IsMemory();
+    }
+}
+
+bool Instruction::ReadsDestination() const
+{
+    switch (opcode)
+    {
+    case EOpcode::Mov:
+    case EOpcode::Movzx:
+    case EOpcode::Movsx:
+    case EOpcode::Movsxd:
+    case EOpcode::Lea:
+    case EOpcode::Setcc:
+    case EOpcode::Pop:
+        return false;
+    default:
+        return !destination.empty();
+    }
+}
+
+bool Instruction::ReadsFlags() const
+{
+    return opcode == EOpcode::Jcc || opcode == EOpcode::Setcc || opcode == EOpcode::Cmovcc;
+}
+
+bool Instruction::IsArithmetic() const
+{
+    switch (opcode)
+    {
+    case EOpcode::Add:
+    case EOpcode::Sub:
+    case EOpcode::Imul:
+    case EOpcode::Inc:
+    case EOpcode::Dec:
+    case EOpcode::Neg:
+    case EOpcode::And:
+    case EOpcode::Shl:
+    case EOpcode::Shr:
+    case EOpcode::Sar:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool Instruction::IsPure() const
+{
+    switch (opcode)
+    {
+    case EOpcode::Mov:
+    case EOpcode::Movzx:
+    case EOpcode::Movsx:
+    case EOpcode::Movsxd:
+    case EOpcode::Lea:
+    case EOpcode::Cmp:
+    case EOpcode::Setcc:
+    case EOpcode::Cmovcc:
+        break;
+    default:
+        if (IsArithmetic()) break;
+        return false;
+    }
+
+    if (WritesMemory() && !destination.IsStackSlot()) return false;
+    return ((GetUsedRegisters() | GetDefinedRegisters()) & FRAME_REGISTERS) == 0;
+}
+
+bool Instruction::WritesFlags() const
+{
+    if (IsArithmetic()) return true;
+
+    switch (opcode)
+    {
+    case EOpcode::Mul:
+    case EOpcode::Div:
+    case EOpcode::Idiv:
+    case EOpcode::Cmp:
+    case EOpcode::Call:
+    case EOpcode::Syscall:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool arhi::AreFlagsReadBeforeWrite(const std::vector<Instruction>& instructions, const size_t begin)
+{
+    for (size_t index = begin; index < instructions.size(); index++)
+    {
+        if (instructions[index].ReadsFlags()) return true;
+        if (instructions[index].WritesFlags()) return false;
+    }
+
+    return false;
+}
+
+bool arhi::IsExitSystemCall(const std::vector<Instruction>& instructions, const size_t index)
+{
+    if (instructions[index].opcode != EOpcode::Syscall) return false;
+
+    size_t writer = index;
+    while (writer > 0 && !(instructions[writer - 1].GetDefinedRegisters() & GetRegisterBit(ERegister::Rax))) writer--;
+    if (writer == 0) return false;
+
+    const Instruction& number = instructions[writer - 1];
+    return number.opcode == EOpcode::Mov && number.source.IsImmediate() && number.source.value == EXIT_SYSTEM_CALL;
+}
+
+size_t arhi::EraseMarked(std::vector<Instruction>& instructions, const std::vector<bool>& marked)
+{
+    size_t kept_count = 0;
+    for (size_t index = 0; index < instructions.size(); index++)
+    {
+        if (marked[index]) continue;
+        if (kept_count != index) instructions[kept_count] = std::move(instructions[index]);
+        kept_count++;
+    }
+
+    const size_t erased_count = instructions.size() - kept_count;
+    instructions.resize(kept_count);
+    return erased_count;
+}
+
+uint32 MachineProgram::BeginFunction(const std::string& name, const bool bEntryPoint)
+{
+    MachineFunction function = {};
+    function.name = name;
+    function.bEntryPoint = bEntryPoint;
+    function.blocks.push_back(BasicBlock{ name, {} });
+    m_Functions.push_back(std::move(function));
+
+    return static_cast<uint32>(m_Functions.size() - 1);
+}
+
+uint32 MachineProgram::BeginBlock(const std::string& label, const uint8 alignment)
+{
+    // Code before the first function lands in an unnamed function that prints without a label
+    if (m_Functions.empty()) m_Functions.push_back(MachineFunction{ {}, { BasicBlock{} } });
+
+    std::vector<BasicBlock>& blocks = m_Functions.back().blocks;
+    if (blocks.back().label.empty() && blocks.back().instructions.empty()) blocks.pop_back();
+    blocks.push_back(BasicBlock{ label, {}, alignment });
+
+    return static_cast<uint32>(blocks.size() - 1);
+}
+
+uint32 MachineProgram::CreateStackSlot(const uint8 size)
+{
+    if (m_Functions.empty()) m_Functions.push_back(MachineFunction{ {}, { BasicBlock{} } });
+
+    std::vector<uint8>& stack_slot_sizes = m_Functions.back().stack_slot_sizes;
+    stack_slot_sizes.push_back(size);
+
+    return static_cast<uint32>(stack_slot_sizes.size() - 1);
+}
+
+BasicBlock& MachineProgram::GetCurrentBlock()
+{
+    if (m_Functions.empty()) m_Functions.push_back(MachineFunction{ {}, { BasicBlock{} } });
+
+    std::vector<BasicBlock>& blocks = m_Functions.back().blocks;
+    const std::vector<Instruction>& instructions = blocks.back().instructions;
+    if (!instructions.empty() && (instructions.back().IsTerminator() || instructions.back().IsBranch()))
+    {
+        blocks.push_back(BasicBlock{});
+    }
+
+    return blocks.back();
+}
+
+void MachineProgram::Emit(const Instruction& instruction)
+{
+    GetCurrentBlock().instructions.push_back(instruction);
+}
+
+size_t MachineProgram::GetInstructionCount() const
+{
+    size_t instruction_count = 0;
+    for (const MachineFunction& function : m_Functions)
+    {
+        for (const BasicBlock& block : function.blocks) instruction_count += block.instructions.size();
+    }
+
+    return instruction_count;
+}
+
+void MachineProgram::PrintOperand(AssemblyEmitter& emitter, const MachineFunction& function, const Operand& operand) const
+{
+    if (operand.bPrintSize) emitter << arhi::GetSizeSpecifier(operand.size) << " ";
+
+    switch (operand.type)
+    {
+    case EOperandType::Register:
+        emitter << arhi::GetRegisterName(operand.reg, operand.size);
+        break;
+    case EOperandType::Memory:
+        emitter << "[" << arhi::GetRegisterName(operand.reg, 8);
+        if (operand.index != ERegister::None)
+        {
+            emitter << "+" << arhi::GetRegisterName(operand.index, 8);
+            if (operand.scale > 1) emitter << "*" << static_cast<uint32>(operand.scale);
+        }
+        if (operand.value < 0) emitter << "-" << -operand.value;
+        else if (operand.value > 0) emitter << "+" << operand.value;
+        emitter << "]";
+        break;
+    case EOperandType::StackSlot:
+        // Only shows up when the frame was never laid out
+        emitter << "[slot" << operand.value << "]";
+        break;
+    case EOperandType::Immediate:
+        emitter << operand.value;
+        break;
+    case EOperandType::Label:
+        emitter << function.blocks[static_cast<size_t>(operand.value)].label;
+        break;
+    case EOperandType::Function:
+        emitter << m_Functions[static_cast<size_t>(operand.value)].name;
+        break;
+    default:
+        break;
+    }
+}
+
+void MachineProgram::Print(AssemblyEmitter& emitter) const
+{
+    for (const MachineFunction& function : m_Functions)
+    {
+        for (const BasicBlock& block : function.blocks)
+        {
+            if (block.alignment > 0) emitter << " align " << static_cast<uint32>(block.alignment) << "\n";
+            if (!block.label.empty()) emitter << block.label << ":\n";
+
+            for (const Instruction& instruction : block.instructions)
+            {
+                emitter << " " << MNEMONICS[static_cast<size_t>(instruction.opcode)] << arhi::GetConditionSuffix(instruction.condition);
+                if (!instruction.destination.empty())
+                {
+                    emitter << " ";
+                    PrintOperand(emitter, function, instruction.destination);
+                }
+                if (!instruction.source.empty())
+                {
+                    emitter << ", ";
+                    PrintOperand(emitter, function, instruction.source);
+                }
+                emitter << "\n";
+            }
+        }
+    }
+}
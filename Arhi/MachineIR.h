@@ -0,0 +1,251 @@
+#pragma once
+
+#include "Types.h"
+#include "AssemblyEmitter.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// In-memory x86-64 code between the front end and the assembly text. The compiler appends instructions
+// with typed operands to basic blocks of machine functions; passes can inspect and rewrite them before
+// MachineProgram::Print turns everything into NASM text in one go.
+
+enum class ERegister : uint8
+{
+	Rax, Rbx, Rcx, Rdx, Rsi, Rdi, Rbp, Rsp,
+	R8, R9, R10, R11, R12, R13, R14, R15,
+	None
+};
+
+enum class EOperandType : uint8
+{
+	None,
+	Register,
+	// [base + index * scale + displacement], only lea uses the index
+	Memory,
+	// A local of the function whose frame position is not known yet, FrameLowering turns it into Memory
+	StackSlot,
+	Immediate,
+	// A basic block of the same function
+	Label,
+	// The entry of another machine function
+	Function
+};
+
+using RegisterMask = uint32;
+
+constexpr RegisterMask GetRegisterBit(const ERegister reg)
+{
+	return reg == ERegister::None ? 0u : 1u << static_cast<uint32>(reg);
+}
+
+// Registers ERegister names, None excluded
+constexpr uint32 REGISTER_COUNT = static_cast<uint32>(ERegister::None);
+// Hold the frame, passes never treat them as values
+constexpr RegisterMask FRAME_REGISTERS = GetRegisterBit(ERegister::Rsp) | GetRegisterBit(ERegister::Rbp);
+constexpr RegisterMask ARGUMENT_REGISTERS = GetRegisterBit(ERegister::Rdi) | GetRegisterBit(ERegister::Rsi) | GetRegisterBit(ERegister::Rdx)
+	| GetRegisterBit(ERegister::Rcx) | GetRegisterBit(ERegister::R8) | GetRegisterBit(ERegister::R9);
+
+struct Operand
+{
+	EOperandType type = EOperandType::None;
+	// Access size in bytes
+	uint8 size = 0;
+	// Prints the size specifier (qword, dword, ...) in front of the operand
+	bool bPrintSize = false;
+	ERegister reg = ERegister::None;
+	ERegister index = ERegister::None;
+	uint8 scale = 1;
+	// Immediate value, memory displacement, stack slot, block index or function index
+	int64 value = 0;
+
+	bool empty() const { return type == EOperandType::None; }
+	bool IsRegister() const { return type == EOperandType::Register; }
+	// Anything that accesses memory, stack slots included
+	bool IsMemory() const { return type == EOperandType::Memory || type == EOperandType::StackSlot; }
+	bool IsStackSlot() const { return type == EOperandType::StackSlot; }
+	bool IsImmediate() const { return type == EOperandType::Immediate; }
+
+	// Same location or value, regardless of how it is printed
+	bool operator==(const Operand& other) const
+	{
+		return type == other.type && size == other.size && reg == other.reg && index == other.index && scale == other.scale && value == other.value;
+	}
+	bool operator!=(const Operand& other) const { return !(*this == other); }
+
+	static Operand Register(const ERegister reg, const uint8 size, const bool bPrintSize = false);
+	static Operand Memory(const ERegister base, const int64 displacement, const uint8 size, const bool bPrintSize = false);
+	// Address computation for lea
+	static Operand Address(const ERegister base, const ERegister index, const uint8 scale, const int64 displacement);
+	static Operand StackSlot(const uint32 slot_index, const uint8 size, const bool bPrintSize = false);
+	static Operand Immediate(const int64 value, const uint8 size = 0);
+	static Operand Label(const uint32 block_index);
+	static Operand Function(const uint32 function_index);
+
+	// Copy with another access size, for example a variable read into a wider register
+	Operand WithSize(const uint8 new_size, const bool bNewPrintSize) const;
+};
+
+enum class EOpcode : uint8
+{
+	Mov,
+	Movzx,
+	Movsx,
+	Movsxd,
+	Lea,
+	Add,
+	Sub,
+	Imul,
+	Mul,
+	// Divide rdx:rax by the destination operand, quotient in rax and remainder in rdx
+	Div,
+	Idiv,
+	// Sign extend eax into edx and rax into rdx for idiv
+	Cdq,
+	Cqo,
+	Inc,
+	Dec,
+	Neg,
+	And,
+	Shl,
+	Shr,
+	Sar,
+	Xchg,
+	Cmp,
+	Cmovcc,
+	Setcc,
+	Jmp,
+	Jcc,
+	Push,
+	Pop,
+	Call,
+	Ret,
+	Syscall
+};
+
+enum class ECondition : uint8
+{
+	None,
+	Equal,
+	NotEqual,
+	Greater,
+	GreaterEqual,
+	Less,
+	LessEqual
+};
+
+struct Instruction
+{
+	EOpcode opcode = EOpcode::Mov;
+	ECondition condition = ECondition::None;
+	Operand destination = {};
+	Operand source = {};
+
+	Instruction() = default;
+	Instruction(EOpcode opcode, const Operand& destination = {}, const Operand& source = {}, ECondition condition = ECondition::None)
+		: opcode(opcode), condition(condition), destination(destination), source(source)
+	{
+	}
+
+	// Ends its basic block: control never falls through to the next instruction
+	bool IsTerminator() const { return opcode == EOpcode::Jmp || opcode == EOpcode::Ret; }
+	bool IsBranch() const { return opcode == EOpcode::Jmp || opcode == EOpcode::Jcc; }
+	// A jump to another function that takes over the return address, the frame is gone by then like at a ret
+	bool IsTailCall() const { return opcode == EOpcode::Jmp && destination.type == EOperandType::Function; }
+
+	// Register sets as bit masks indexed by ERegister. Writes to 8 and 16 bit sub registers keep the rest
+	// of the register, so they count as a use as well.
+	RegisterMask GetUsedRegisters() const;
+	RegisterMask GetDefinedRegisters() const;
+	// Stores into its memory destination operand
+	bool WritesMemory() const;
+	// False for instructions that only write their destination, like mov or setcc
+	bool ReadsDestination() const;
+	// Add, sub, imul, inc, dec, neg, and and the shifts: they change their destination by what it holds and set the flags
+	bool IsArithmetic() const;
+	// Copies, arithmetic, cmp, setcc and cmovcc that leave the frame registers alone and write nothing but their
+	// destination register or stack slot and the flags, so removing or moving them changes nothing else
+	bool IsPure() const;
+	// Conditional instructions read the flags, arithmetic, cmp and calls overwrite them
+	bool ReadsFlags() const;
+	bool WritesFlags() const;
+};
+
+struct BasicBlock
+{
+	// Printed as "label:" in front of the block, blocks that are only reached by falling through have none
+	std::string label = {};
+	std::vector<Instruction> instructions = {};
+	// Printed as "align N" in front of the label when it is not 0
+	uint8 alignment = 0;
+};
+
+enum class EInlineHint : uint8
+{
+	None,
+	// Declared with "define inline", copied into every caller regardless of its size
+	Always,
+	// Declared with "define noinline"
+	Never
+};
+
+struct MachineFunction
+{
+	std::string name = {};
+	std::vector<BasicBlock> blocks = {};
+	// Declared size of every stack slot
+	std::vector<uint8> stack_slot_sizes = {};
+	// Entered by the operating system instead of a call, so there is no return address on the stack
+	bool bEntryPoint = false;
+	EInlineHint inline_hint = EInlineHint::None;
+};
+
+class MachineProgram
+{
+public:
+	MachineProgram() = default;
+	~MachineProgram() = default;
+
+	// Starts a new function whose entry block carries its name as label, returns its index
+	uint32 BeginFunction(const std::string& name, const bool bEntryPoint = false);
+	// Reserves a stack slot in the current function, returns its index for Operand::StackSlot
+	uint32 CreateStackSlot(const uint8 size);
+	// Starts a labelled block in the current function and returns its index, so branches can target it
+	uint32 BeginBlock(const std::string& label, const uint8 alignment = 0);
+
+	// Appends to the current block. Instructions after a branch or terminator open a new unlabelled block.
+	void Emit(const Instruction& instruction);
+	void Emit(EOpcode opcode, const Operand& destination = {}, const Operand& source = {}, ECondition condition = ECondition::None)
+	{
+		Emit(Instruction(opcode, destination, source, condition));
+	}
+
+	std::vector<MachineFunction>& GetFunctions() { return m_Functions; }
+	const std::vector<MachineFunction>& GetFunctions() const { return m_Functions; }
+	size_t GetInstructionCount() const;
+
+	void Print(AssemblyEmitter& emitter) const;
+
+private:
+	BasicBlock& GetCurrentBlock();
+	void PrintOperand(AssemblyEmitter& emitter, const MachineFunction& function, const Operand& operand) const;
+
+private:
+	std::vector<MachineFunction> m_Functions = {};
+};
+
+namespace arhi
+{
+	std::string_view GetRegisterName(const ERegister reg, const uint8 size);
+	std::string_view GetSizeSpecifier(const uint8 size);
+	std::string_view GetConditionSuffix(const ECondition condition);
+	// Wraps a value into 'size' bytes and sign extends it back, like storing it in a register of that size
+	int64 TruncateToSize(const int64 value, const uint8 size);
+	// Whether an instruction from 'begin' on reads the flags before one overwrites them. Flags are never
+	// carried into another block, so the end of the block counts as an overwrite.
+	bool AreFlagsReadBeforeWrite(const std::vector<Instruction>& instructions, const size_t begin);
+	// A syscall whose number, the last value written to rax in front of it, is exit. Nothing runs after it.
+	bool IsExitSystemCall(const std::vector<Instruction>& instructions, const size_t index);
+	// Removes the instructions whose entry in 'marked' is set, the others keep their order. Returns how many went away.
+	size_t EraseMarked(std::vector<Instruction>& instructions, const std::vector<bool>& marked);
+}
@@ -0,0 +1,119 @@
+#include "PassManager.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+namespace
+{
+    bool Contains(const std::vector<std::string>& names, const std::string& name)
+    {
+        return std::find(names.begin(), names.end(), name) != names.end();
+    }
+}
+
+void PassManager::AddPass(const std::string& name, const EOptimizationLevel minimum_level, const PassFunction& function)
+{
+    m_Passes.push_back(Pass{ name, minimum_level, false, function });
+}
+
+void PassManager::AddRequiredPass(const std::string& name, const PassFunction& function)
+{
+    m_Passes.push_back(Pass{ name, EOptimizationLevel::O0, true, function });
+}
+
+void PassManager::Run(MachineProgram& program, std::ostream& statistics)
+{
+    CheckPassNames();
+
+    // A stream without a buffer drops everything written to it
+    std::ostream discarded_statistics = std::ostream(nullptr);
+    std::ostream& pass_statistics = m_Options.bPrintStatistics ? statistics : discarded_statistics;
+    for (Pass& pass : m_Passes)
+    {
+        if (!IsEnabled(pass)) continue;
+
+        const auto start = std::chrono::steady_clock::now();
+        pass.function(program, pass_statistics);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        pass.seconds = elapsed.count();
+    }
+
+    if (m_Options.bTimePasses) PrintTimings(statistics);
+}
+
+bool PassManager::IsEnabled(const Pass& pass) const
+{
+    if (pass.bRequired) return true;
+    if (Contains(m_Options.disabled_passes, pass.name)) return false;
+
+    return m_Options.level >= pass.minimum_level || Contains(m_Options.enabled_passes, pass.name);
+}
+
+bool PassManager::IsKnownPass(const std::string& name) const
+{
+    return std::any_of(m_Passes.begin(), m_Passes.end(), [&name](const Pass& pass)
+    {
+        return pass.name == name;
+    });
+}
+
+void PassManager::CheckPassNames() const
+{
+    for (const std::string& name : m_Options.enabled_passes)
+    {
+        if (!IsKnownPass(name)) std::cerr << "[Warning] Unknown pass '" << name << "' cannot be enabled!\n";
+    }
+
+    for (const std::string& name : m_Options.disabled_passes)
+    {
+        if (!IsKnownPass(name))
+        {
+            std::cerr << "[Warning] Unknown pass '" << name << "' cannot be disabled!\n";
+            continue;
+        }
+
+        const bool bRequired = std::any_of(m_Passes.begin(), m_Passes.end(), [&name](const Pass& pass)
+        {
+            return pass.name == name && pass.bRequired;
+        });
+        if (bRequired) std::cerr << "[Warning] The pass '" << name << "' is required and stays enabled!\n";
+    }
+}
+
+void PassManager::PrintTimings(std::ostream& statistics) const
+{
+    size_t name_width = 0;
+    for (const Pass& pass : m_Passes) name_width = std::max(name_width, pass.name.length());
+
+    double total_seconds = 0.0;
+    statistics << "Pass timings at " << arhi::GetOptimizationLevelName(m_Options.level) << ":\n";
+    for (const Pass& pass : m_Passes)
+    {
+        statistics << "  " << std::left << std::setw(static_cast<int>(name_width)) << pass.name << "  ";
+        if (!IsEnabled(pass))
+        {
+            statistics << "disabled\n";
+            continue;
+        }
+
+        statistics << std::right << std::fixed << std::setprecision(3) << std::setw(9) << pass.seconds * 1000.0 << " ms\n";
+        total_seconds += pass.seconds;
+    }
+    statistics << "  " << std::left << std::setw(static_cast<int>(name_width)) << "total" << "  "
+        << std::right << std::fixed << std::setprecision(3) << std::setw(9) << total_seconds * 1000.0 << " ms\n";
+    statistics << std::defaultfloat;
+}
+
+namespace arhi
+{
+    std::string_view GetOptimizationLevelName(const EOptimizationLevel level)
+    {
+        switch (level)
+        {
+        case EOptimizationLevel::O0: return "-O0";
+        case EOptimizationLevel::O1: return "-O1";
+        default: return "-O2";
+        }
+    }
+}
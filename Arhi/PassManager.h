@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Types.h"
+#include "MachineIR.h"
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class EOptimizationLevel : uint8
+{
+	// Only what the program needs to run: the frame is laid out, nothing is optimized
+	O0,
+	// Cheap clean-up: register allocation, peephole and dead code elimination
+	O1,
+	// Everything, inlining, tail calls and loop invariant code motion included
+	O2
+};
+
+struct PassOptions
+{
+	EOptimizationLevel level = EOptimizationLevel::O2;
+	// Pass names from --enable-pass and --disable-pass, they override what the level selects
+	std::vector<std::string> enabled_passes = {};
+	std::vector<std::string> disabled_passes = {};
+	// Prints the statistics line of every pass that ran
+	bool bPrintStatistics = false;
+	// Prints how long every pass took after the pipeline ran
+	bool bTimePasses = false;
+};
+
+// Runs the machine program passes between code generation and the assembly text in the order they were
+// added. Every pass has a name the command line can switch it on and off with and the lowest optimization
+// level that runs it. A pass writes its statistics line to the stream it is given, which only reaches the
+// output with --pass-stats.
+class PassManager
+{
+public:
+	using PassFunction = std::function<void(MachineProgram& program, std::ostream& statistics)>;
+
+	explicit PassManager(const PassOptions& options) : m_Options(options) {}
+	~PassManager() = default;
+
+	// A name may be added more than once, switching it affects every run
+	void AddPass(const std::string& name, const EOptimizationLevel minimum_level, const PassFunction& function);
+	// Runs at every level and cannot be disabled
+	void AddRequiredPass(const std::string& name, const PassFunction& function);
+
+	void Run(MachineProgram& program, std::ostream& statistics);
+
+private:
+	struct Pass
+	{
+		std::string name = {};
+		EOptimizationLevel minimum_level = EOptimizationLevel::O0;
+		bool bRequired = false;
+		PassFunction function = {};
+		double seconds = 0.0;
+	};
+
+	bool IsEnabled(const Pass& pass) const;
+	bool IsKnownPass(const std::string& name) const;
+	// Warns about names on the command line that no pass has
+	void CheckPassNames() const;
+	void PrintTimings(std::ostream& statistics) const;
+
+private:
+	PassOptions m_Options = {};
+	std::vector<Pass> m_Passes = {};
+};
+
+namespace arhi
+{
+	std::string_view GetOptimizationLevelName(const EOptimizationLevel level);
+}
@@ -0,0 +1,302 @@
+#include "Peephole.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace
+{
+    // How many instructions CoalesceCopies looks ahead for the next write of the copied register
+    constexpr size_t COPY_WINDOW_SIZE = 8;
+
+    bool IsMove(const Instruction& instruction)
+    {
+        return instruction.opcode == EOpcode::Mov;
+    }
+
+    bool Overlaps(const Operand& first, const Operand& second)
+    {
+        // Different stack slots never share bytes until the frame is laid out
+        if (first.type != second.type) return true;
+        if (first.IsStackSlot()) return first.value == second.value;
+        if (first.reg != second.reg || first.index != ERegister::None || second.index != ERegister::None) return true;
+        return first.value < second.value + second.size && second.value < first.value + first.size;
+    }
+
+    bool FitsInImmediate32(const int64 value)
+    {
+        return value >= INT32_MIN && value <= INT32_MAX;
+    }
+}
+
+size_t PeepholeOptimizer::Run(MachineProgram& program)
+{
+    const size_t instruction_count = program.GetInstructionCount();
+
+    for (MachineFunction& function : program.GetFunctions())
+    {
+        RemoveUnreachableCode(function);
+
+        bool bChanged = false;
+        do
+        {
+            bChanged = false;
+            for (BasicBlock& block : function.blocks)
+            {
+                bChanged |= ForwardStores(block);
+                bChanged |= CoalesceCopies(block);
+                bChanged |= FoldReadModifyWrite(block);
+                bChanged |= SelectAddressArithmetic(block);
+                bChanged |= RemoveSelfMoves(block);
+            }
+        } while (bChanged);
+    }
+
+    return instruction_count - program.GetInstructionCount();
+}
+
+bool PeepholeOptimizer::RemoveUnreachableCode(MachineFunction& function)
+{
+    bool bChanged = false;
+    bool bReachable = true;
+
+    for (BasicBlock& block : function.blocks)
+    {
+        // Only labelled blocks can be the target of a branch
+        if (!block.label.empty()) bReachable = true;
+
+        if (!bReachable)
+        {
+            bChanged |= !block.instructions.empty();
+            block.instructions.clear();
+            continue;
+        }
+
+        if (!block.instructions.empty()) bReachable = !block.instructions.back().IsTerminator();
+    }
+
+    return bChanged;
+}
+
+bool PeepholeOptimizer::ForwardStores(BasicBlock& block)
+{
+    bool bChanged = false;
+    m_StoredValues.clear();
+
+    std::vector<Instruction>& instructions = block.instructions;
+    size_t index = 0;
+    while (index < instructions.size())
+    {
+        Instruction& instruction = instructions[index];
+
+        if (IsMove(instruction) && instruction.destination.IsRegister() && instruction.source.IsMemory())
+        {
+            const auto stored = std::find_if(m_StoredValues.begin(), m_StoredValues.end(), [&instruction](const StoredValue& stored)
+            {
+                return stored.slot == instruction.source;
+            });
+
+            if (stored != m_StoredValues.end())
+            {
+                bChanged = true;
+                if (stored->value == instruction.destination && instruction.destination.size != 4)
+                {
+                    // The register still holds exactly what was stored
+                    instructions.erase(instructions.begin() + index);
+                    continue;
+                }
+                instruction.source = stored->value;
+            }
+        }
+
+        index++;
+        if (instruction.opcode == EOpcode::Call || instruction.opcode == EOpcode::Syscall)
+        {
+            m_StoredValues.clear();
+            continue;
+        }
+
+        const RegisterMask defined_registers = instruction.GetDefinedRegisters();
+        const bool bWritesMemory = instruction.WritesMemory();
+        m_StoredValues.erase(std::remove_if(m_StoredValues.begin(), m_StoredValues.end(), [&](const StoredValue& stored)
+        {
+            if ((GetRegisterBit(stored.slot.reg) | GetRegisterBit(stored.value.reg)) & defined_registers) return true;
+            if (bWritesMemory && instruction.destination.IsMemory() && Overlaps(stored.slot, instruction.destination)) return true;
+            return bWritesMemory && instruction.source.IsMemory() && Overlaps(stored.slot, instruction.source);
+        }), m_StoredValues.end());
+
+        if (IsMove(instruction) && instruction.destination.IsMemory() && (instruction.source.IsRegister() || instruction.source.IsImmediate()))
+        {
+            StoredValue stored = {};
+            stored.slot = instruction.destination.WithSize(instruction.destination.size, false);
+            stored.value = instruction.source.IsRegister() ? instruction.source.WithSize(instruction.source.size, false)
+                : Operand::Immediate(instruction.source.value);
+            m_StoredValues.push_back(stored);
+        }
+    }
+
+    return bChanged;
+}
+
+bool PeepholeOptimizer::IsOverwrittenBeforeUse(const BasicBlock& block, size_t begin, const ERegister reg) const
+{
+    const RegisterMask register_bit = GetRegisterBit(reg);
+    const size_t end = std::min(block.instructions.size(), begin + COPY_WINDOW_SIZE);
+
+    for (size_t index = begin; index < end; index++)
+    {
+        const Instruction& instruction = block.instructions[index];
+        if (instruction.GetUsedRegisters() & register_bit) return false;
+        if (instruction.GetDefinedRegisters() & register_bit) return true;
+    }
+
+    return false;
+}
+
+bool PeepholeOptimizer::CoalesceCopies(BasicBlock& block)
+{
+    bool bChanged = false;
+
+    std::vector<Instruction>& instructions = block.instructions;
+    for (size_t index = 0; index + 1 < instructions.size(); index++)
+    {
+        const Instruction& first = instructions[index];
+        Instruction& second = instructions[index + 1];
+
+        // A 32 bit or wider write replaces the whole register, so nothing of its old value survives
+        if ((!IsMove(first) && first.opcode != EOpcode::Lea) || !first.destination.IsRegister() || first.destination.size < 4) continue;
+        if (!IsMove(second) || !second.source.IsRegister() || second.source != first.destination) continue;
+        if (second.destination.IsRegister() && second.destination.reg == first.destination.reg) continue;
+        if (!IsOverwrittenBeforeUse(block, index + 2, first.destination.reg)) continue;
+
+        const Operand& value = first.source;
+        if (first.opcode == EOpcode::Lea)
+        {
+            if (!second.destination.IsRegister() || second.destination.size != first.destination.size) continue;
+
+            second = Instruction(EOpcode::Lea, second.destination.WithSize(second.destination.size, false), value);
+        }
+        else if (second.destination.IsRegister())
+        {
+            if (second.destination.size != first.destination.size) continue;
+
+            const Operand destination = second.destination.WithSize(second.destination.size, false);
+            second.source = value.IsMemory() ? value.WithSize(destination.size, false) : value;
+            second.destination = destination;
+        }
+        else if (second.destination.IsMemory() && value.IsImmediate() && FitsInImmediate32(value.value))
+        {
+            second.destination = second.destination.WithSize(second.source.size, true);
+            second.source = value;
+        }
+        else
+        {
+            continue;
+        }
+
+        instructions.erase(instructions.begin() + index);
+        bChanged = true;
+    }
+
+    return bChanged;
+}
+
+bool PeepholeOptimizer::FoldReadModifyWrite(BasicBlock& block)
+{
+    bool bChanged = false;
+
+    std::vector<Instruction>& instructions = block.instructions;
+    for (size_t index = 0; index + 2 < instructions.size(); index++)
+    {
+        const Instruction& load = instructions[index];
+        const Instruction& operation = instructions[index + 1];
+        const Instruction& store = instructions[index + 2];
+
+        if (!IsMove(load) || !load.destination.IsRegister() || !(load.source.IsRegister() || load.source.IsMemory())) continue;
+        if (!operation.IsArithmetic() || operation.destination != load.destination) continue;
+        if (!IsMove(store) || store.source != load.destination || store.destination.WithSize(store.destination.size, false) != load.source.WithSize(load.source.size, false)) continue;
+
+        const Operand& temporary = load.destination;
+        const Operand& variable = load.source;
+        if (variable.IsRegister() && variable.reg == temporary.reg) continue;
+        // x86 has no memory to memory arithmetic and imul can only write a register
+        if (variable.IsMemory() && (operation.source.IsMemory() || operation.opcode == EOpcode::Imul)) continue;
+        if ((operation.source.IsRegister() || operation.source.IsMemory()) && operation.source.reg == temporary.reg) continue;
+        if (!IsOverwrittenBeforeUse(block, index + 3, temporary.reg)) continue;
+
+        // Without a register operand nothing tells the assembler how wide the memory access is
+        Instruction folded = operation;
+        folded.destination = variable.WithSize(variable.size, variable.IsMemory() && !operation.source.IsRegister());
+        instructions[index] = folded;
+        instructions.erase(instructions.begin() + index + 1, instructions.begin() + index + 3);
+        bChanged = true;
+    }
+
+    return bChanged;
+}
+
+bool PeepholeOptimizer::SelectAddressArithmetic(BasicBlock& block)
+{
+    bool bChanged = false;
+
+    std::vector<Instruction>& instructions = block.instructions;
+    for (size_t index = 0; index + 1 < instructions.size(); index++)
+    {
+        const Instruction& copy = instructions[index];
+        const Instruction& operation = instructions[index + 1];
+
+        if (!IsMove(copy) || !copy.destination.IsRegister() || !copy.source.IsRegister() || copy.destination.reg == copy.source.reg) continue;
+        if (copy.destination.size < 4 || copy.source.size != copy.destination.size || operation.destination != copy.destination) continue;
+
+        const ERegister base = copy.source.reg;
+        const Operand& value = operation.source;
+        Operand address = {};
+        if (operation.opcode == EOpcode::Add && value.IsImmediate())
+        {
+            address = Operand::Address(base, ERegister::None, 1, value.value);
+        }
+        else if (operation.opcode == EOpcode::Sub && value.IsImmediate() && value.value != INT32_MIN)
+        {
+            address = Operand::Address(base, ERegister::None, 1, -value.value);
+        }
+        else if (operation.opcode == EOpcode::Add && value.IsRegister() && value.size == copy.destination.size && value.reg != copy.destination.reg)
+        {
+            address = Operand::Address(base, value.reg, 1, 0);
+        }
+        else if (operation.opcode == EOpcode::Shl && value.IsImmediate() && value.value == 1)
+        {
+            address = Operand::Address(base, base, 1, 0);
+        }
+        else if (operation.opcode == EOpcode::Imul && value.IsImmediate() && (value.value == 3 || value.value == 5 || value.value == 9))
+        {
+            // base + base * (n - 1), the scale can only be 1, 2, 4 or 8
+            address = Operand::Address(base, base, static_cast<uint8>(value.value - 1), 0);
+        }
+        else
+        {
+            continue;
+        }
+        // lea leaves the flags alone, so it can only replace an add whose flags nobody reads
+        if (arhi::AreFlagsReadBeforeWrite(instructions, index + 2)) continue;
+
+        // Address arithmetic is 64 bit wide, the low half of the result is the same as with the 32 bit add
+        instructions[index] = Instruction(EOpcode::Lea, copy.destination.WithSize(copy.destination.size, false), address);
+        instructions.erase(instructions.begin() + index + 1);
+        bChanged = true;
+    }
+
+    return bChanged;
+}
+
+bool PeepholeOptimizer::RemoveSelfMoves(BasicBlock& block)
+{
+    // A 32 bit move clears the upper half of the register, so "mov eax, eax" is not a no-op
+    const auto is_self_move = [](const Instruction& instruction)
+    {
+        return IsMove(instruction) && instruction.destination.IsRegister() && instruction.destination == instruction.source
+            && instruction.destination.size != 4;
+    };
+
+    const size_t instruction_count = block.instructions.size();
+    block.instructions.erase(std::remove_if(block.instructions.begin(), block.instructions.end(), is_self_move), block.instructions.end());
+
+    return block.instructions.size() != instruction_count;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Types.h"
+#include "MachineIR.h"
+#include <vector>
+
+// Window based clean-up of the machine program after code generation. Every statement is lowered on its
+// own, so the output is full of reloads of values that are still in a register, copies through rax and
+// epilogues behind an explicit return. The optimizer removes those without changing what the program does.
+class PeepholeOptimizer
+{
+public:
+	PeepholeOptimizer() = default;
+	~PeepholeOptimizer() = default;
+
+	// Rewrites the program in place until nothing changes anymore, returns the number of removed instructions
+	size_t Run(MachineProgram& program);
+
+private:
+	// Drops blocks that control can neither jump to nor fall into, like a second epilogue after 'return'
+	bool RemoveUnreachableCode(MachineFunction& function);
+	// Replaces loads of a stack slot that was just stored with the stored register or immediate
+	bool ForwardStores(BasicBlock& block);
+	// Turns "mov A, x / mov B, A" into "mov B, x" when A is overwritten before it is read again, same for lea
+	bool CoalesceCopies(BasicBlock& block);
+	// Turns "mov A, x / add A, y / mov x, A" into "add x, y", so variables are changed where they live
+	bool FoldReadModifyWrite(BasicBlock& block);
+	// Turns "mov A, B / add A, y" into "lea A, [B + y]" and doublings and multiplications by 3, 5 and 9 into lea as well
+	bool SelectAddressArithmetic(BasicBlock& block);
+	bool RemoveSelfMoves(BasicBlock& block);
+
+	bool IsOverwrittenBeforeUse(const BasicBlock& block, size_t begin, ERegister reg) const;
+
+private:
+	struct StoredValue
+	{
+		Operand slot = {};
+		Operand value = {};
+	};
+
+	// Stores that are still valid at the current instruction of ForwardStores, reused between blocks
+	std::vector<StoredValue> m_StoredValues = {};
+};
@@ -0,0 +1,173 @@
+#include "RegisterAllocator.h"
+#include <algorithm>
+
+namespace
+{
+    // Caller-saved registers first, they cost nothing to use. The callee-saved ones need a push and a pop.
+    constexpr ERegister ALLOCATION_ORDER[] = {
+        ERegister::Rsi, ERegister::Rdi, ERegister::R8, ERegister::R9, ERegister::R10, ERegister::R11,
+        ERegister::Rcx, ERegister::Rdx, ERegister::Rax,
+        ERegister::R12, ERegister::R13, ERegister::R14, ERegister::R15, ERegister::Rbx
+    };
+}
+
+void RegisterAllocator::Run(MachineProgram& program)
+{
+    m_SlotCount = 0;
+    m_PromotedSlotCount = 0;
+    m_CoalescedParameterCount = 0;
+
+    for (MachineFunction& function : program.GetFunctions())
+    {
+        if (function.stack_slot_sizes.empty()) continue;
+
+        CollectPromotableSlots(function);
+        m_Intervals = arhi::ComputeStackSlotIntervals(function);
+
+        // Registers referenced by more than one instruction cannot be handed to a parameter
+        RegisterMask referenced_registers = GetRegisterBit(ERegister::Rsp) | GetRegisterBit(ERegister::Rbp);
+        RegisterMask shared_registers = referenced_registers;
+        for (const BasicBlock& block : function.blocks)
+        {
+            for (const Instruction& instruction : block.instructions)
+            {
+                const RegisterMask registers = instruction.GetUsedRegisters() | instruction.GetDefinedRegisters();
+                shared_registers |= referenced_registers & registers;
+                referenced_registers |= registers;
+            }
+        }
+
+        CoalesceParameters(function, shared_registers);
+        ScanLiveIntervals(~referenced_registers);
+        RewriteStackSlots(function);
+
+        m_SlotCount += function.stack_slot_sizes.size();
+    }
+}
+
+void RegisterAllocator::CollectPromotableSlots(const MachineFunction& function)
+{
+    m_Assignments.assign(function.stack_slot_sizes.size(), SlotAssignment());
+
+    for (const BasicBlock& block : function.blocks)
+    {
+        for (const Instruction& instruction : block.instructions)
+        {
+            for (const Operand* operand : { &instruction.destination, &instruction.source })
+            {
+                if (!operand->IsStackSlot()) continue;
+
+                // Narrower reads are the low part of the register, a narrower write would keep bytes the register loses
+                const uint8 slot_size = function.stack_slot_sizes[static_cast<size_t>(operand->value)];
+                const bool bWrite = operand == &instruction.destination && instruction.WritesMemory();
+                if (operand->size > slot_size || (bWrite && operand->size != slot_size))
+                {
+                    m_Assignments[static_cast<size_t>(operand->value)].bPromotable = false;
+                }
+            }
+        }
+    }
+}
+
+void RegisterAllocator::CoalesceParameters(const MachineFunction& function, const RegisterMask shared_registers)
+{
+    if (function.blocks.empty()) return;
+
+    // The only instruction that touches the register is the store, so the register holds the slot for the whole
+    // function and the store turns into a copy of the register into itself
+    for (const Instruction& instruction : function.blocks.front().instructions)
+    {
+        if (instruction.opcode != EOpcode::Mov || !instruction.destination.IsStackSlot() || !instruction.source.IsRegister()) continue;
+        if (instruction.source.size != instruction.destination.size || (shared_registers & GetRegisterBit(instruction.source.reg))) continue;
+
+        SlotAssignment& assignment = m_Assignments[static_cast<size_t>(instruction.destination.value)];
+        if (!assignment.bPromotable || assignment.reg != ERegister::None) continue;
+
+        assignment.reg = instruction.source.reg;
+        m_CoalescedParameterCount++;
+    }
+}
+
+void RegisterAllocator::ScanLiveIntervals(RegisterMask free_registers)
+{
+    std::vector<size_t> slots = {};
+    for (size_t slot_index = 0; slot_index < m_Assignments.size(); slot_index++)
+    {
+        const SlotAssignment& assignment = m_Assignments[slot_index];
+        if (assignment.bPromotable && assignment.reg == ERegister::None && !m_Intervals[slot_index].empty()) slots.push_back(slot_index);
+    }
+    std::sort(slots.begin(), slots.end(), [this](const size_t first, const size_t second)
+    {
+        return m_Intervals[first].start < m_Intervals[second].start;
+    });
+
+    std::vector<size_t> active = {};
+    for (const size_t slot_index : slots)
+    {
+        const LiveInterval& interval = m_Intervals[slot_index];
+        SlotAssignment& assignment = m_Assignments[slot_index];
+
+        // Intervals that ended before this one starts give their register back
+        active.erase(std::remove_if(active.begin(), active.end(), [this, &interval, &free_registers](const size_t active_index)
+        {
+            if (m_Intervals[active_index].end >= interval.start) return false;
+            free_registers |= GetRegisterBit(m_Assignments[active_index].reg);
+            return true;
+        }), active.end());
+
+        for (const ERegister reg : ALLOCATION_ORDER)
+        {
+            if (free_registers & GetRegisterBit(reg))
+            {
+                assignment.reg = reg;
+                free_registers &= ~GetRegisterBit(reg);
+                break;
+            }
+        }
+
+        if (assignment.reg == ERegister::None)
+        {
+            // Out of registers: whichever of the live slots is used least goes back to memory
+            const auto cheapest = std::min_element(active.begin(), active.end(), [this](const size_t first, const size_t second)
+            {
+                return m_Intervals[first].weight < m_Intervals[second].weight;
+            });
+            if (cheapest == active.end() || m_Intervals[*cheapest].weight >= interval.weight) continue;
+
+            std::swap(assignment.reg, m_Assignments[*cheapest].reg);
+            active.erase(cheapest);
+        }
+
+        active.push_back(slot_index);
+    }
+
+    for (const SlotAssignment& assignment : m_Assignments)
+    {
+        if (assignment.reg != ERegister::None) m_PromotedSlotCount++;
+    }
+}
+
+void RegisterAllocator::RewriteStackSlots(MachineFunction& function) const
+{
+    std::vector<bool> self_copies = {};
+    for (BasicBlock& block : function.blocks)
+    {
+        self_copies.assign(block.instructions.size(), false);
+        for (size_t index = 0; index < block.instructions.size(); index++)
+        {
+            Instruction& instruction = block.instructions[index];
+            // Reads of a promoted slot are never wider than the slot, so the upper half a 4 byte copy clears is never read
+            self_copies[index] = instruction.opcode == EOpcode::Mov && instruction.destination.IsStackSlot() && instruction.source.IsRegister()
+                && m_Assignments[static_cast<size_t>(instruction.destination.value)].reg == instruction.source.reg;
+
+            for (Operand* operand : { &instruction.destination, &instruction.source })
+            {
+                if (!operand->IsStackSlot()) continue;
+
+                const ERegister reg = m_Assignments[static_cast<size_t>(operand->value)].reg;
+                if (reg != ERegister::None) *operand = Operand::Register(reg, operand->size);
+            }
+        }
+        arhi::EraseMarked(block.instructions, self_copies);
+    }
+}
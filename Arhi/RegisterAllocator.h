@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Types.h"
+#include "MachineIR.h"
+#include "Liveness.h"
+#include <vector>
+
+// Keeps stack slot locals in registers. Every stack slot of a function is a virtual register: liveness
+// analysis over the basic blocks gives each one a live interval, and a linear scan hands out the registers
+// the function never touches otherwise. When they run out, the slot with the lowest use weight (uses inside
+// loops count more) stays in memory and gets its place in the frame from FrameLowering. A parameter whose
+// argument register nothing but its own store touches simply stays in that register.
+class RegisterAllocator
+{
+public:
+	RegisterAllocator() = default;
+	~RegisterAllocator() = default;
+
+	void Run(MachineProgram& program);
+
+	size_t GetSlotCount() const { return m_SlotCount; }
+	size_t GetPromotedSlotCount() const { return m_PromotedSlotCount; }
+	size_t GetCoalescedParameterCount() const { return m_CoalescedParameterCount; }
+
+private:
+	struct SlotAssignment
+	{
+		bool bPromotable = true;
+		ERegister reg = ERegister::None;
+	};
+
+	// Slots written narrower than they are declared or read wider stay in memory
+	void CollectPromotableSlots(const MachineFunction& function);
+	// Gives "mov [slot], reg" in the entry block the register when the function references it nowhere else
+	void CoalesceParameters(const MachineFunction& function, const RegisterMask shared_registers);
+	void ScanLiveIntervals(RegisterMask free_registers);
+	// Removes the copies of a coalesced parameter into itself
+	void RewriteStackSlots(MachineFunction& function) const;
+
+private:
+	std::vector<SlotAssignment> m_Assignments = {};
+	std::vector<LiveInterval> m_Intervals = {};
+
+	size_t m_SlotCount = 0;
+	size_t m_PromotedSlotCount = 0;
+	size_t m_CoalescedParameterCount = 0;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Types.h"
+#include "SymbolTable.h"
+#include <vector>
+
+// Entries (variables, functions) bound to interned symbols in nested scopes. The innermost binding of
+// every symbol lives in a table indexed by the symbol id, so a lookup is one array access instead of a
+// walk over all scopes. Every entry remembers the binding it shadows, which makes inner declarations
+// hide outer ones and lets PopScope restore them by walking only the entries of the popped scope.
+// 'T' needs a 'symbol' member.
+template <typename T>
+class ScopedSymbolTable
+{
+public:
+	ScopedSymbolTable() = default;
+	~ScopedSymbolTable() = default;
+
+	void PushScope()
+	{
+		m_ScopeStarts.push_back(static_cast<uint32>(m_Entries.size()));
+	}
+
+	void PopScope()
+	{
+		if (m_ScopeStarts.empty()) return;
+
+		const uint32 scope_start = m_ScopeStarts.back();
+		m_ScopeStarts.pop_back();
+
+		while (m_Entries.size() > scope_start)
+		{
+			const uint32 symbol = m_Entries.back().symbol;
+			if (symbol != INVALID_SYMBOL) m_Bindings[symbol] = m_ShadowedEntries.back();
+
+			m_Entries.pop_back();
+			m_ShadowedEntries.pop_back();
+		}
+	}
+
+	// Binds the entry in the innermost scope. The reference is valid until the next declaration.
+	T& Declare(const T& entry)
+	{
+		const uint32 entry_index = static_cast<uint32>(m_Entries.size());
+		if (entry.symbol == INVALID_SYMBOL)
+		{
+			// Entries without a name stay unreachable but still belong to their scope
+			m_ShadowedEntries.push_back(INVALID_ENTRY);
+		}
+		else
+		{
+			if (entry.symbol >= m_Bindings.size()) m_Bindings.resize(static_cast<size_t>(entry.symbol) + 1, INVALID_ENTRY);
+			m_ShadowedEntries.push_back(m_Bindings[entry.symbol]);
+			m_Bindings[entry.symbol] = entry_index;
+		}
+
+		m_Entries.push_back(entry);
+		return m_Entries.back();
+	}
+
+	// Innermost entry bound to the symbol or nullptr
+	const T* Find(const uint32 symbol) const
+	{
+		if (symbol >= m_Bindings.size() || m_Bindings[symbol] == INVALID_ENTRY) return nullptr;
+		return &m_Entries[m_Bindings[symbol]];
+	}
+
+	size_t GetScopeDepth() const { return m_ScopeStarts.size(); }
+
+private:
+	static constexpr uint32 INVALID_ENTRY = 0xFFFFFFFFu;
+
+	std::vector<T> m_Entries = {};
+	std::vector<uint32> m_ShadowedEntries = {};
+	std::vector<uint32> m_ScopeStarts = {};
+	std::vector<uint32> m_Bindings = {};
+};
@@ -0,0 +1,133 @@
+#include "SourceFile.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SourceFile::~SourceFile()
+{
+    Close();
+}
+
+bool SourceFile::Open(const std::string& file_name)
+{
+    Close();
+
+    if (Map(file_name)) return true;
+    return Read(file_name);
+}
+
+void SourceFile::Close()
+{
+    if (m_bIsMapped)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_pData);
+        CloseHandle(m_MappingHandle);
+        CloseHandle(m_FileHandle);
+        m_MappingHandle = nullptr;
+        m_FileHandle = nullptr;
+#else
+        munmap(const_cast<char*>(m_pData), m_Size);
+        close(m_FileDescriptor);
+        m_FileDescriptor = -1;
+#endif
+    }
+
+    m_FallbackBuffer.clear();
+    m_FallbackBuffer.shrink_to_fit();
+    m_pData = nullptr;
+    m_Size = 0;
+    m_bIsMapped = false;
+}
+
+bool SourceFile::Map(const std::string& file_name)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER file_size = {};
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        // Empty files cannot be mapped, the read fallback handles them
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m_FileHandle = file;
+    m_MappingHandle = mapping;
+    m_pData = static_cast<const char*>(data);
+    m_Size = static_cast<size_t>(file_size.QuadPart);
+#else
+    const int32 file_descriptor = open(file_name.c_str(), O_RDONLY);
+    if (file_descriptor < 0) return false;
+
+    struct stat file_status = {};
+    if (fstat(file_descriptor, &file_status) != 0 || file_status.st_size == 0)
+    {
+        // Empty files cannot be mapped, the read fallback handles them
+        close(file_descriptor);
+        return false;
+    }
+
+    void* data = mmap(nullptr, static_cast<size_t>(file_status.st_size), PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    if (data == MAP_FAILED)
+    {
+        close(file_descriptor);
+        return false;
+    }
+    madvise(data, static_cast<size_t>(file_status.st_size), MADV_SEQUENTIAL);
+
+    m_FileDescriptor = file_descriptor;
+    m_pData = static_cast<const char*>(data);
+    m_Size = static_cast<size_t>(file_status.st_size);
+#endif
+
+    m_bIsMapped = true;
+    return true;
+}
+
+bool SourceFile::Read(const std::string& file_name)
+{
+    std::ifstream file = std::ifstream(file_name, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Tokenize error! Could not open " << file_name;
+        return false;
+    }
+
+    std::stringstream buffer = {};
+    buffer << file.rdbuf();
+    m_FallbackBuffer = buffer.str();
+
+    m_pData = m_FallbackBuffer.data();
+    m_Size = m_FallbackBuffer.size();
+    return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Types.h"
+#include <string>
+#include <string_view>
+
+// Read-only view of a source file. The file is memory mapped whenever the platform allows it,
+// so tokens can point straight into the mapped pages instead of owning copies of the text.
+// If mapping fails the file is read into an owned buffer and exposed through the same view.
+class SourceFile
+{
+public:
+	SourceFile() = default;
+	SourceFile(const SourceFile&) = delete;
+	SourceFile& operator=(const SourceFile&) = delete;
+	~SourceFile();
+
+	bool Open(const std::string& file_name);
+	void Close();
+
+	std::string_view GetView() const { return std::string_view(m_pData, m_Size); }
+	bool IsMapped() const { return m_bIsMapped; }
+
+private:
+	bool Map(const std::string& file_name);
+	bool Read(const std::string& file_name);
+
+private:
+	const char* m_pData = nullptr;
+	size_t m_Size = 0;
+	bool m_bIsMapped = false;
+
+	std::string m_FallbackBuffer = {};
+
+#ifdef _WIN32
+	void* m_FileHandle = nullptr;
+	void* m_MappingHandle = nullptr;
+#else
+	int32 m_FileDescriptor = -1;
+#endif
+};
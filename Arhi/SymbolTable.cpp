@@ -0,0 +1,65 @@
+#include "SymbolTable.h"
+#include "Lexicon.h"
+
+namespace
+{
+    const uint32 SYMBOL_HASH_SEED = 2166136261u;
+}
+
+uint32 SymbolTable::Intern(std::string_view name)
+{
+    const uint32 hash = arhi::HashWord(name, SYMBOL_HASH_SEED);
+    size_t slot = FindSlot(name, hash);
+    if (m_Slots[slot] != INVALID_SYMBOL) return m_Slots[slot];
+
+    // Keep the load factor at or below one half so probe sequences stay short
+    if ((m_Offsets.size() + 1) * 2 > m_Slots.size())
+    {
+        Grow();
+        slot = FindSlot(name, hash);
+    }
+
+    const uint32 symbol = static_cast<uint32>(m_Offsets.size());
+    m_Offsets.push_back(static_cast<uint32>(m_Characters.size()));
+    m_Lengths.push_back(static_cast<uint32>(name.length()));
+    m_Hashes.push_back(hash);
+    m_Characters.append(name);
+
+    m_Slots[slot] = symbol;
+    return symbol;
+}
+
+uint32 SymbolTable::Find(std::string_view name) const
+{
+    return m_Slots[FindSlot(name, arhi::HashWord(name, SYMBOL_HASH_SEED))];
+}
+
+size_t SymbolTable::FindSlot(std::string_view name, const uint32 hash) const
+{
+    const size_t mask = m_Slots.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+    {
+        const uint32 symbol = m_Slots[slot];
+        if (symbol == INVALID_SYMBOL) return slot;
+        if (m_Hashes[symbol] == hash && GetName(symbol) == name) return slot;
+    }
+}
+
+void SymbolTable::Grow()
+{
+    m_Slots.assign(m_Slots.size() * 2, INVALID_SYMBOL);
+
+    const size_t mask = m_Slots.size() - 1;
+    for (uint32 symbol = 0; symbol < m_Offsets.size(); symbol++)
+    {
+        size_t slot = m_Hashes[symbol] & mask;
+        while (m_Slots[slot] != INVALID_SYMBOL) slot = (slot + 1) & mask;
+        m_Slots[slot] = symbol;
+    }
+}
+
+size_t SymbolTable::GetMemoryFootprint() const
+{
+    return m_Characters.capacity() + m_Offsets.capacity() * sizeof(uint32) + m_Lengths.capacity() * sizeof(uint32)
+        + m_Hashes.capacity() * sizeof(uint32) + m_Slots.capacity() * sizeof(uint32);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Types.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+constexpr uint32 INVALID_SYMBOL = 0xFFFFFFFFu;
+
+// Interned identifiers. Every distinct name is stored once in a shared character buffer and gets a
+// dense integer id, so comparing two names is a single integer compare.
+class SymbolTable
+{
+public:
+	SymbolTable() = default;
+	~SymbolTable() = default;
+
+	// Returns the id of the name and adds it on first use
+	uint32 Intern(std::string_view name);
+	// Returns the id of the name or INVALID_SYMBOL if it was never interned
+	uint32 Find(std::string_view name) const;
+
+	// The view stays valid until the next name is added
+	std::string_view GetName(const uint32 symbol) const
+	{
+		if (symbol >= m_Offsets.size()) return {};
+		return std::string_view(m_Characters).substr(m_Offsets[symbol], m_Lengths[symbol]);
+	}
+	size_t GetSymbolCount() const { return m_Offsets.size(); }
+
+	size_t GetMemoryFootprint() const;
+
+private:
+	size_t FindSlot(std::string_view name, const uint32 hash) const;
+	void Grow();
+
+private:
+	std::string m_Characters = {};
+	std::vector<uint32> m_Offsets = {};
+	std::vector<uint32> m_Lengths = {};
+	std::vector<uint32> m_Hashes = {};
+
+	// Open addressing with linear probing, every slot holds a symbol id or INVALID_SYMBOL
+	std::vector<uint32> m_Slots = std::vector<uint32>(64, INVALID_SYMBOL);
+};
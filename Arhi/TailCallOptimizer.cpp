@@ -0,0 +1,62 @@
+#include "TailCallOptimizer.h"
+
+void TailCallOptimizer::Run(MachineProgram& program)
+{
+    m_TailCallCount = 0;
+    m_RecursionLoopCount = 0;
+
+    std::vector<MachineFunction>& functions = program.GetFunctions();
+    for (size_t function_index = 0; function_index < functions.size(); function_index++)
+    {
+        MachineFunction& function = functions[function_index];
+        // The entry point has no return address a callee could use
+        if (function.bEntryPoint) continue;
+
+        uint32 body_block = 0;
+        for (size_t block_index = 0; block_index < function.blocks.size(); block_index++)
+        {
+            std::vector<Instruction>& instructions = function.blocks[block_index].instructions;
+            if (instructions.size() < 2 || instructions.back().opcode != EOpcode::Ret) continue;
+
+            const Instruction& call = instructions[instructions.size() - 2];
+            if (call.opcode != EOpcode::Call) continue;
+
+            const Operand callee = call.destination;
+            instructions.pop_back();
+            if (static_cast<size_t>(callee.value) != function_index)
+            {
+                instructions.back() = Instruction(EOpcode::Jmp, callee);
+                m_TailCallCount++;
+                continue;
+            }
+
+            if (body_block == 0)
+            {
+                body_block = SplitEntryBlock(function);
+                // Every block from the entry on moved one further
+                block_index++;
+            }
+            function.blocks[block_index].instructions.back() = Instruction(EOpcode::Jmp, Operand::Label(body_block));
+            m_RecursionLoopCount++;
+        }
+    }
+}
+
+uint32 TailCallOptimizer::SplitEntryBlock(MachineFunction& function) const
+{
+    for (BasicBlock& block : function.blocks)
+    {
+        for (Instruction& instruction : block.instructions)
+        {
+            if (instruction.destination.type == EOperandType::Label && instruction.destination.value >= 1) instruction.destination.value++;
+        }
+    }
+
+    BasicBlock body = {};
+    body.label = function.name + "_BODY";
+    body.instructions = std::move(function.blocks[0].instructions);
+    function.blocks[0].instructions.clear();
+    function.blocks.insert(function.blocks.begin() + 1, std::move(body));
+
+    return 1;
+}
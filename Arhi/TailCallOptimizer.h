@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Types.h"
+#include "MachineIR.h"
+#include <vector>
+
+// Turns a call that is directly followed by ret into a jump, so "return f(...)" leaves the stack as it
+// found it. FrameLowering tears the frame down in front of the jump like in front of a ret, and the callee
+// returns straight to our caller. A function calling itself this way jumps back to the start of its own
+// body instead: the arguments are in the parameter registers already, the body stores them again and the
+// recursion runs as a loop inside a single frame.
+class TailCallOptimizer
+{
+public:
+	TailCallOptimizer() = default;
+	~TailCallOptimizer() = default;
+
+	void Run(MachineProgram& program);
+
+	size_t GetTailCallCount() const { return m_TailCallCount; }
+	size_t GetRecursionLoopCount() const { return m_RecursionLoopCount; }
+
+private:
+	// Moves the code of the entry block into a new block behind it, the prologue goes into the entry block
+	// later and the recursive calls jump to the new one. Returns its index.
+	uint32 SplitEntryBlock(MachineFunction& function) const;
+
+private:
+	size_t m_TailCallCount = 0;
+	size_t m_RecursionLoopCount = 0;
+};
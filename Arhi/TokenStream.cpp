@@ -0,0 +1,71 @@
+#include "TokenStream.h"
+
+void TokenStream::Clear()
+{
+    m_Types.clear();
+    m_Offsets.clear();
+    m_Lengths.clear();
+    m_Lines.clear();
+    m_Symbols.clear();
+    m_LineStarts.assign(1, 0);
+}
+
+void TokenStream::Append(const TokenStream& other, size_t first_token_line, size_t last_token_line, uint32 line_offset)
+{
+    if (first_token_line >= last_token_line) return;
+
+    const size_t begin = other.m_LineStarts[first_token_line];
+    const size_t end = other.m_LineStarts[last_token_line];
+    const size_t destination_begin = m_Types.size();
+
+    m_Types.insert(m_Types.end(), other.m_Types.begin() + begin, other.m_Types.begin() + end);
+    m_Offsets.insert(m_Offsets.end(), other.m_Offsets.begin() + begin, other.m_Offsets.begin() + end);
+    m_Lengths.insert(m_Lengths.end(), other.m_Lengths.begin() + begin, other.m_Lengths.begin() + end);
+    m_Symbols.insert(m_Symbols.end(), other.m_Symbols.begin() + begin, other.m_Symbols.begin() + end);
+
+    const size_t first_new_line = m_Lines.size();
+    m_Lines.insert(m_Lines.end(), other.m_Lines.begin() + begin, other.m_Lines.begin() + end);
+    for (size_t index = first_new_line; index < m_Lines.size(); index++)
+    {
+        m_Lines[index] += line_offset;
+    }
+
+    for (size_t line_index = first_token_line + 1; line_index <= last_token_line; line_index++)
+    {
+        m_LineStarts.push_back(static_cast<uint32>(destination_begin + other.m_LineStarts[line_index] - begin));
+    }
+}
+
+size_t TokenStream::FindTokenLine(uint32 line) const
+{
+    size_t low = 0;
+    size_t high = GetLineCount();
+
+    while (low < high)
+    {
+        const size_t middle = low + (high - low) / 2;
+        if (m_Lines[m_LineStarts[middle]] < line) low = middle + 1;
+        else high = middle;
+    }
+
+    return low;
+}
+
+void TokenStream::GetTokenLine(size_t line_index, std::vector<Token>& tokens) const
+{
+    const size_t begin = m_LineStarts[line_index];
+    const size_t end = m_LineStarts[line_index + 1];
+
+    tokens.clear();
+    for (size_t index = begin; index < end; index++)
+    {
+        tokens.push_back(GetToken(index));
+    }
+}
+
+size_t TokenStream::GetMemoryFootprint() const
+{
+    return m_Types.capacity() * sizeof(ETokenType) + m_Offsets.capacity() * sizeof(uint32)
+        + m_Lengths.capacity() * sizeof(uint32) + m_Lines.capacity() * sizeof(uint32) + m_Symbols.capacity() * sizeof(uint32)
+        + m_LineStarts.capacity() * sizeof(uint32);
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "Types.h"
+#include "SymbolTable.h"
+#include <string_view>
+#include <vector>
+
+enum class ETokenType : uint8
+{
+	Variable = 0,
+	Name = 1,
+	Numeric = 2,
+	Keyword = 3,
+	Macro = 4,
+	Operator = 5,
+	BooleanOperator = 6,
+	Comment = 7,
+	Semicolon = 8,
+	Assignment = 9,
+	Referral = 10,
+	Parenthesis = 11,
+	Scope = 12,
+	IndexOperator = 13,
+	Unkown = 14
+};
+
+struct Token
+{
+	ETokenType type = ETokenType::Unkown;
+	std::string_view value = {};
+	uint32 line = 0;
+	// Interned id of a Name token, INVALID_SYMBOL for every other token
+	uint32 symbol = INVALID_SYMBOL;
+
+	bool empty() const 
+	{
+		return value == "" && line == 0 && type == ETokenType::Unkown;
+	}
+
+	Token() = default;
+	Token(ETokenType token, std::string_view value, uint32 line, uint32 symbol = INVALID_SYMBOL)
+		: type(token), value(value), line(line), symbol(symbol)
+	{
+	}
+	~Token() = default;
+};
+
+// All tokens of a source file in one structure-of-arrays buffer. Every token is a type, an offset and
+// a length into the source code, its line number and its symbol id; a token line (statement) is the
+// index range between two entries of m_LineStarts. Values are rebuilt as views into the source on demand.
+class TokenStream
+{
+public:
+	TokenStream() = default;
+	explicit TokenStream(std::string_view source_code)
+		: m_SourceCode(source_code)
+	{
+	}
+	~TokenStream() = default;
+
+	// The value has to be a view into the source code this stream was created with
+	void Push(ETokenType type, std::string_view value, uint32 line, uint32 symbol = INVALID_SYMBOL)
+	{
+		m_Types.push_back(type);
+		m_Offsets.push_back(static_cast<uint32>(value.data() - m_SourceCode.data()));
+		m_Lengths.push_back(static_cast<uint32>(value.length()));
+		m_Lines.push_back(line);
+		m_Symbols.push_back(symbol);
+	}
+
+	// Closes the current token line, lines without any tokens are dropped
+	void EndLine()
+	{
+		if (m_LineStarts.back() != m_Types.size()) m_LineStarts.push_back(static_cast<uint32>(m_Types.size()));
+	}
+
+	void Clear();
+	// Appends the token lines [first_token_line, last_token_line) of a stream over the same source code,
+	// shifting their line numbers by 'line_offset'
+	void Append(const TokenStream& other, size_t first_token_line, size_t last_token_line, uint32 line_offset);
+
+	size_t GetTokenCount() const { return m_Types.size(); }
+	size_t GetLineCount() const { return m_LineStarts.size() - 1; }
+	size_t GetLineBegin(size_t line_index) const { return m_LineStarts[line_index]; }
+	size_t GetLineEnd(size_t line_index) const { return m_LineStarts[line_index + 1]; }
+
+	// Index of the first token line whose source line is at least 'line'
+	size_t FindTokenLine(uint32 line) const;
+
+	ETokenType GetType(size_t index) const { return m_Types[index]; }
+	uint32 GetLine(size_t index) const { return m_Lines[index]; }
+	uint32 GetSymbol(size_t index) const { return m_Symbols[index]; }
+	void SetSymbol(size_t index, uint32 symbol) { m_Symbols[index] = symbol; }
+	std::string_view GetValue(size_t index) const { return m_SourceCode.substr(m_Offsets[index], m_Lengths[index]); }
+	Token GetToken(size_t index) const { return Token(m_Types[index], GetValue(index), m_Lines[index], m_Symbols[index]); }
+
+	// Copies one token line into a reusable buffer, so consumers can keep working on token vectors
+	void GetTokenLine(size_t line_index, std::vector<Token>& tokens) const;
+
+	size_t GetMemoryFootprint() const;
+
+private:
+	std::string_view m_SourceCode = {};
+
+	std::vector<ETokenType> m_Types = {};
+	std::vector<uint32> m_Offsets = {};
+	std::vector<uint32> m_Lengths = {};
+	std::vector<uint32> m_Lines = {};
+	std::vector<uint32> m_Symbols = {};
+	std::vector<uint32> m_LineStarts = { 0 };
+};
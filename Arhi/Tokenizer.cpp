@@ -1,93 +1,262 @@
 #include "Tokenizer.h"
+#include "Lexicon.h"
+#include "CharScan.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 
-std::ostream& operator<<(std::ostream& os, ETokenType tokenType) {
-    switch (tokenType) {
-    case ETokenType::Variable:
-        os << "Variable";
-        break;
-    case ETokenType::Name:
-        os << "Name";
-        break;
-    case ETokenType::Numeric:
-        os << "Numeric";
-        break;
-    case ETokenType::Keyword:
-        os << "Keyword";
-        break;
-    case ETokenType::Macro:
-        os << "Macro";
-        break;
-    case ETokenType::Operator:
-        os << "Operator";
-        break;
-    case ETokenType::BooleanOperator:
-        os << "Boolean operator";
-        break;
-    case ETokenType::IndexOperator:
-        os << "index operator";
-        break;
-    case ETokenType::Comment:
-        os << "Comment";
-        break;
-    case ETokenType::Semicolon:
-        os << "Semicolon";
-        break;
-    case ETokenType::Assignment:
-        os << "Assignment";
-        break;
-    case ETokenType::Referral:
-        os << "Referral";
-        break;
-    case ETokenType::Parenthesis:
-        os << "Parenthesis";
-        break;
-    case ETokenType::Scope:
-        os << "Scope";
-        break;
-    case ETokenType::Unkown:
-        os << "Unkown";
-        break;
-    default:
-        os << "Unknown Token Type";
-        break;
+const size_t TRACE_BUFFER_FLUSH_SIZE = 64 * 1024;
+
+namespace
+{
+    std::string_view TokenTypeName(ETokenType token_type)
+    {
+        switch (token_type)
+        {
+        case ETokenType::Variable:
+            return "Variable";
+        case ETokenType::Name:
+            return "Name";
+        case ETokenType::Numeric:
+            return "Numeric";
+        case ETokenType::Keyword:
+            return "Keyword";
+        case ETokenType::Macro:
+            return "Macro";
+        case ETokenType::Operator:
+            return "Operator";
+        case ETokenType::BooleanOperator:
+            return "Boolean operator";
+        case ETokenType::IndexOperator:
+            return "index operator";
+        case ETokenType::Comment:
+            return "Comment";
+        case ETokenType::Semicolon:
+            return "Semicolon";
+        case ETokenType::Assignment:
+            return "Assignment";
+        case ETokenType::Referral:
+            return "Referral";
+        case ETokenType::Parenthesis:
+            return "Parenthesis";
+        case ETokenType::Scope:
+            return "Scope";
+        case ETokenType::Unkown:
+            return "Unkown";
+        default:
+            return "Unknown Token Type";
+        }
     }
-    return os;
-}
 
-const std::vector<std::string> variables = { "bool", "boolean", "byte", "int8", "uint8", "int16", "uint16", "int32", "uint32", "int64", "uint64", "void" };
-const std::vector<std::string> operators = { "++", "--", "->", "+", "-", "*", "/", "," };
-const std::vector<std::string> boolean_operators = { "?", "<=", "<", ">=", ">", "==", "!=" };
-const std::vector<std::string> keywords = { "global", "local", "if", "define", "return", "true", "false" };
-const std::vector<std::string> arhi_macros = { "exit!", "negate!", "clamp!", "repeat!", "swap!" };
+    // Reads past the end of a line as '\0', like indexing a std::string at its length did
+    inline char CharAt(std::string_view source_line, const size_t index)
+    {
+        return index < source_line.length() ? source_line[index] : '\0';
+    }
+}
 
 void Tokenizer::Tokenize()
 {
-    std::stringstream input = std::stringstream(m_SourceCode);
-	std::string line = { };
-    uint32 line_number = 1;
+    while (TokenizeNextSourceLine())
+    {
+    }
+
+    FlushTokenTrace();
+
+    if (m_OnCompletionEvent) m_OnCompletionEvent(m_Tokens);
+}
+
+bool Tokenizer::NextLine(std::vector<Token>& line_tokens)
+{
+    m_Tokens.Clear();
+
+    while (m_Tokens.GetLineCount() == 0)
+    {
+        if (!TokenizeNextSourceLine())
+        {
+            FlushTokenTrace();
+            return false;
+        }
+    }
+
+    m_Tokens.GetTokenLine(0, line_tokens);
+    return true;
+}
+
+bool Tokenizer::TokenizeNextSourceLine()
+{
+    if (m_NextLineBegin >= m_SourceCode.length()) return false;
+
+    size_t line_end = m_SourceCode.find('\n', m_NextLineBegin);
+    if (line_end == std::string_view::npos) line_end = m_SourceCode.length();
+
+    TokenizeSingleLine(m_SourceCode.substr(m_NextLineBegin, line_end - m_NextLineBegin), m_NextLineNumber);
+    m_NextLineBegin = line_end + 1;
+    m_NextLineNumber++;
+
+    return true;
+}
+
+struct Tokenizer::ChunkResult
+{
+    std::string_view chunk = {};
+    uint32 line_count = 0;
+
+    // Lexed as if the chunk started outside of a comment, with the comment state after every line
+    TokenStream tokens = {};
+    std::vector<bool> line_ends_in_comment = {};
+    std::vector<size_t> trace_line_ends = {};
+    std::string trace = {};
+
+    // Lexed as if the chunk started inside a comment, only until both variants agree at a line end
+    TokenStream in_comment_tokens = {};
+    uint32 in_comment_line_count = 0;
+    bool bInCommentEndsInComment = false;
+    std::vector<size_t> in_comment_trace_line_ends = {};
+    std::string in_comment_trace = {};
+};
+
+void Tokenizer::LexChunk(std::string_view chunk, std::string_view source_code, bool bTraceTokens, ChunkResult& result)
+{
+    Tokenizer lexer = Tokenizer(chunk, source_code, false, bTraceTokens);
+    while (lexer.TokenizeNextSourceLine())
+    {
+        result.line_ends_in_comment.push_back(lexer.m_bIsInComment);
+        if (bTraceTokens) result.trace_line_ends.push_back(lexer.m_TraceBuffer.size());
+    }
+    result.line_count = lexer.m_NextLineNumber - 1;
+    result.tokens = std::move(lexer.m_Tokens);
+    result.trace = std::move(lexer.m_TraceBuffer);
+
+    // Both variants produce the same tokens from the first line end where their comment states match
+    Tokenizer in_comment_lexer = Tokenizer(chunk, source_code, true, bTraceTokens);
+    while (in_comment_lexer.TokenizeNextSourceLine())
+    {
+        const uint32 line_index = in_comment_lexer.m_NextLineNumber - 2;
+        if (bTraceTokens) result.in_comment_trace_line_ends.push_back(in_comment_lexer.m_TraceBuffer.size());
+        if (in_comment_lexer.m_bIsInComment == result.line_ends_in_comment[line_index]) break;
+    }
+    result.in_comment_line_count = in_comment_lexer.m_NextLineNumber - 1;
+    result.bInCommentEndsInComment = in_comment_lexer.m_bIsInComment;
+    result.in_comment_tokens = std::move(in_comment_lexer.m_Tokens);
+    result.in_comment_trace = std::move(in_comment_lexer.m_TraceBuffer);
+}
+
+void Tokenizer::TokenizeParallel(const uint32 thread_count, const size_t min_chunk_size)
+{
+    const size_t chunk_count = std::min<size_t>(static_cast<size_t>(thread_count) * 4, m_SourceCode.length() / min_chunk_size);
+    if (thread_count <= 1 || chunk_count < 2)
+    {
+        Tokenize();
+        return;
+    }
+
+    // Chunks end right after a line break, so no line (and no comment marker) is split
+    std::vector<ChunkResult> chunks = std::vector<ChunkResult>(chunk_count);
+    size_t chunk_begin = 0;
+    for (size_t chunk_index = 0; chunk_index < chunk_count && chunk_begin < m_SourceCode.length(); chunk_index++)
+    {
+        size_t chunk_end = m_SourceCode.length();
+        if (chunk_index + 1 < chunk_count)
+        {
+            const size_t split_position = std::max(chunk_begin, m_SourceCode.length() / chunk_count * (chunk_index + 1));
+            chunk_end = m_SourceCode.find('\n', split_position);
+            chunk_end = chunk_end == std::string_view::npos ? m_SourceCode.length() : chunk_end + 1;
+        }
+
+        chunks[chunk_index].chunk = m_SourceCode.substr(chunk_begin, chunk_end - chunk_begin);
+        chunk_begin = chunk_end;
+    }
+
+    std::atomic<size_t> next_chunk = 0;
+    const auto worker = [this, &chunks, &next_chunk]()
+    {
+        for (size_t chunk_index = next_chunk++; chunk_index < chunks.size(); chunk_index = next_chunk++)
+        {
+            if (chunks[chunk_index].chunk.empty()) continue;
+            LexChunk(chunks[chunk_index].chunk, m_SourceCode, m_bTraceTokens, chunks[chunk_index]);
+        }
+    };
+
+    std::vector<std::thread> workers = {};
+    for (uint32 thread_index = 1; thread_index < std::min<size_t>(thread_count, chunk_count); thread_index++)
+    {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : workers) thread.join();
 
-    while (std::getline(input, line))
+    // Stitch the chunks in order, picking the variant that matches the comment state the previous chunk ended in
+    uint32 line_offset = m_NextLineNumber - 1;
+    for (ChunkResult& result : chunks)
     {
-        TokenizeSingleLine(line, line_number);
-        line_number++;
+        if (result.line_count == 0) continue;
+
+        const size_t first_new_token = m_Tokens.GetTokenCount();
+        uint32 taken_lines = 0;
+        if (m_bIsInComment)
+        {
+            taken_lines = result.in_comment_line_count;
+            m_Tokens.Append(result.in_comment_tokens, 0, result.in_comment_tokens.GetLineCount(), line_offset);
+            if (m_bTraceTokens) m_TraceBuffer.append(result.in_comment_trace);
+            m_bIsInComment = result.bInCommentEndsInComment;
+        }
+        if (taken_lines < result.line_count)
+        {
+            const size_t first_token_line = result.tokens.FindTokenLine(taken_lines + 1);
+            m_Tokens.Append(result.tokens, first_token_line, result.tokens.GetLineCount(), line_offset);
+            if (m_bTraceTokens)
+            {
+                const size_t trace_begin = taken_lines == 0 ? 0 : result.trace_line_ends[taken_lines - 1];
+                m_TraceBuffer.append(result.trace, trace_begin, std::string::npos);
+            }
+            m_bIsInComment = result.line_ends_in_comment.back();
+        }
+
+        for (size_t index = first_new_token; index < m_Tokens.GetTokenCount(); index++)
+        {
+            if (m_Tokens.GetType(index) == ETokenType::Name) m_Tokens.SetSymbol(index, m_Symbols.Intern(m_Tokens.GetValue(index)));
+        }
+        if (m_bTraceTokens && m_pTokenTrace && m_TraceBuffer.size() >= TRACE_BUFFER_FLUSH_SIZE) FlushTokenTrace();
+
+        line_offset += result.line_count;
     }
 
-	m_OnCompletionEvent(m_Tokens);
+    m_NextLineBegin = m_SourceCode.length();
+    m_NextLineNumber = line_offset + 1;
+
+    FlushTokenTrace();
+
+    if (m_OnCompletionEvent) m_OnCompletionEvent(m_Tokens);
 }
 
-void Tokenizer::TokenizeSingleLine(const std::string& source_line, const uint32 line_number)
+void Tokenizer::EnableTokenTrace(std::ostream& trace_stream)
+{
+    m_bTraceTokens = true;
+    m_pTokenTrace = &trace_stream;
+}
+
+void Tokenizer::TokenizeSingleLine(std::string_view source_line, const uint32 line_number)
 {
     size_t i = 0;
     const size_t length = source_line.length();
-    std::vector<Token> line_tokens = { };
+    const size_t line_token_begin = m_Tokens.GetTokenCount();
 
     while (i < length)
     {
+        if (m_bIsInComment)
+        {
+            // Only '*' and '/' can change anything inside a block comment
+            i = arhi::FindCommentSymbol(source_line, i);
+            if (i >= length) break;
+        }
+
         const char current_symbol = source_line[i];
+        const size_t symbol_index = i;
 
         if (current_symbol == '/')
         {
@@ -110,167 +279,141 @@ void Tokenizer::TokenizeSingleLine(const std::string& source_line, const uint32
             continue;
         }
 
-        if (!std::isspace(current_symbol))
+        if (arhi::HasCharClass(current_symbol, arhi::Space))
+        {
+            i = arhi::SkipSpaces(source_line, i);
+            continue;
+        }
+
+        if (arhi::HasCharClass(current_symbol, arhi::IdentifierStart))
         {
-            if (std::isalpha(current_symbol) || current_symbol == '_')
+            const size_t type_begin = i;
+            i = arhi::SkipIdentifierCharacters(source_line, i);
+            while (i < length && !arhi::HasCharClass(source_line[i], arhi::IdentifierStop))
             {
-                bool bShouldBreak = false;
-
-                std::string type = {};
-                while (i < length && !std::isspace(source_line[i]) && source_line[i] != ':' 
-                    && source_line[i] != '(' && source_line[i] != ')' && !IsOperator(std::string(1, source_line[i]))
-                    && source_line[i] != ';' && source_line[i] != '[' && source_line[i] != ']')
-                {
-                    type.push_back(source_line[i]);
-                    i++;
-                }
-
-                for (const std::string& variable : variables)
-                {
-                    if (variable == type)
-                    {
-                        line_tokens.push_back({ ETokenType::Variable, type, line_number });
-                        bShouldBreak = true;
-                        break;
-                    }
-                }
-                if (bShouldBreak) continue;
-                for (const std::string& macro : arhi_macros)
-                {
-                    if (macro == type)
-                    {
-                        line_tokens.push_back({ ETokenType::Macro, type, line_number });
-                        bShouldBreak = true;
-                        break;
-                    }
-                }
-                if (bShouldBreak) continue;
-                for (const std::string& keyword : keywords)
-                {
-                    if (type == keyword)
-                    {
-                        line_tokens.push_back({ ETokenType::Keyword, type, line_number });
-                        bShouldBreak = true;
-                        break;
-                    }
-                }
-                if (bShouldBreak) continue;
-
-                line_tokens.push_back({ ETokenType::Name, type, line_number });  
-                if (source_line[i] == '(' || source_line[i] == ')' || IsOperator(std::string(1, source_line[i]))
-                    || source_line[i] == ';' || source_line[i] == ':' || source_line[i] != '[' || source_line[i] != ']') i--;
+                i++;
             }
-            else if (std::isdigit(current_symbol) || (current_symbol == '-' && std::isdigit(source_line[i + 1])))
+            const std::string_view type = source_line.substr(type_begin, i - type_begin);
+
+            const ETokenType reserved_type = arhi::gIdentifierTable.Find(type);
+            if (reserved_type != ETokenType::Unkown)
             {
-                std::string number = {};
-                while (i < length && (std::isdigit(source_line[i]) || source_line[i] == '-'))
-                {
-                    number.push_back(source_line[i]);
-                    i++;
-                }
-                line_tokens.push_back({ ETokenType::Numeric, number, line_number });
+                m_Tokens.Push(reserved_type, type, line_number);
                 continue;
             }
-            else if (IsBooleanOperator(std::string(1, current_symbol)) || source_line[i] == '=' || source_line[i] == '!')
-            {
-                std::string arhioperator = {};
-                while (IsBooleanOperator(std::string(1, source_line[i])) || source_line[i] == '=' || source_line[i] == '!')
-                {
-                    arhioperator.push_back(source_line[i]);
-                    i++;
-                }
-
-                if (IsBooleanOperator(arhioperator))
-                {
-                    line_tokens.push_back({ ETokenType::BooleanOperator, arhioperator, line_number });
-                    continue;
-                }
-                if (source_line[i] == ';' || std::isdigit(source_line[i]) || std::isalpha(source_line[i])) i--;
-            }
-            else if (IsOperator(std::string(1, current_symbol)) || source_line[i] == '>')
-            {
-                std::string arhioperator = {};
-                while (IsOperator(std::string(1, source_line[i])) || source_line[i] == '>')
-                {
-                    arhioperator.push_back(source_line[i]);
-                    i++;
-                }
-
-                if (IsOperator(arhioperator))
-                {
-                    line_tokens.push_back({ ETokenType::Operator, arhioperator, line_number });
-                    continue;
-                }
-                if (source_line[i] == ';' || std::isdigit(source_line[i]) || std::isalpha(source_line[i])) i--;
-            }
-            if (current_symbol == '(' || current_symbol == ')')
-            {
-                const std::string value = std::string(1, current_symbol);
-                line_tokens.push_back({ ETokenType::Parenthesis, value, line_number });
-            }
-            else if (current_symbol == '[' || current_symbol == ']')
+
+            m_Tokens.Push(ETokenType::Name, type, line_number, m_bInternSymbols ? m_Symbols.Intern(type) : INVALID_SYMBOL);
+            const char next_symbol = CharAt(source_line, i);
+            if (next_symbol == '(' || next_symbol == ')' || arhi::HasCharClass(next_symbol, arhi::OperatorSymbol)
+                || next_symbol == ';' || next_symbol == ':' || next_symbol != '[' || next_symbol != ']') i--;
+        }
+        else if (arhi::HasCharClass(current_symbol, arhi::Digit) || (current_symbol == '-' && arhi::HasCharClass(CharAt(source_line, i + 1), arhi::Digit)))
+        {
+            const size_t number_begin = i;
+            i = arhi::SkipDigits(source_line, i);
+            while (i < length && (arhi::HasCharClass(source_line[i], arhi::Digit) || source_line[i] == '-'))
             {
-                const std::string value = std::string(1, current_symbol);
-                line_tokens.push_back({ ETokenType::IndexOperator, value, line_number });
+                i++;
             }
-            else if (current_symbol == '{' || current_symbol == '}')
+            m_Tokens.Push(ETokenType::Numeric, source_line.substr(number_begin, i - number_begin), line_number);
+            continue;
+        }
+        else if (arhi::HasCharClass(current_symbol, arhi::BooleanOperatorSymbol) || current_symbol == '=' || current_symbol == '!')
+        {
+            const size_t operator_begin = i;
+            while (arhi::HasCharClass(CharAt(source_line, i), arhi::BooleanOperatorSymbol) || CharAt(source_line, i) == '=' || CharAt(source_line, i) == '!')
             {
-                const std::string value = std::string(1, current_symbol);
-                line_tokens.push_back({ ETokenType::Scope, value, line_number });
+                i++;
             }
-            else if (current_symbol == '=')
+
+            const std::string_view arhioperator = source_line.substr(operator_begin, i - operator_begin);
+            if (IsBooleanOperator(arhioperator))
             {
-                line_tokens.push_back({ ETokenType::Assignment, "=", line_number });
+                m_Tokens.Push(ETokenType::BooleanOperator, arhioperator, line_number);
+                continue;
             }
-            else if (current_symbol == ':')
+            const char next_symbol = CharAt(source_line, i);
+            if (next_symbol == ';' || arhi::HasCharClass(next_symbol, arhi::Digit | arhi::Alpha)) i--;
+        }
+        else if (arhi::HasCharClass(current_symbol, arhi::OperatorSymbol) || current_symbol == '>')
+        {
+            const size_t operator_begin = i;
+            while (arhi::HasCharClass(CharAt(source_line, i), arhi::OperatorSymbol) || CharAt(source_line, i) == '>')
             {
-                line_tokens.push_back({ ETokenType::Referral, ":", line_number });
+                i++;
             }
-            else if (current_symbol == ';')
+
+            const std::string_view arhioperator = source_line.substr(operator_begin, i - operator_begin);
+            if (IsOperator(arhioperator))
             {
-                line_tokens.push_back({ ETokenType::Semicolon, ";", line_number });
+                m_Tokens.Push(ETokenType::Operator, arhioperator, line_number);
+                continue;
             }
+            const char next_symbol = CharAt(source_line, i);
+            if (next_symbol == ';' || arhi::HasCharClass(next_symbol, arhi::Digit | arhi::Alpha)) i--;
+        }
+        if (current_symbol == '(' || current_symbol == ')')
+        {
+            m_Tokens.Push(ETokenType::Parenthesis, source_line.substr(symbol_index, 1), line_number);
+        }
+        else if (current_symbol == '[' || current_symbol == ']')
+        {
+            m_Tokens.Push(ETokenType::IndexOperator, source_line.substr(symbol_index, 1), line_number);
+        }
+        else if (current_symbol == '{' || current_symbol == '}')
+        {
+            m_Tokens.Push(ETokenType::Scope, source_line.substr(symbol_index, 1), line_number);
+        }
+        else if (current_symbol == '=')
+        {
+            m_Tokens.Push(ETokenType::Assignment, source_line.substr(symbol_index, 1), line_number);
+        }
+        else if (current_symbol == ':')
+        {
+            m_Tokens.Push(ETokenType::Referral, source_line.substr(symbol_index, 1), line_number);
+        }
+        else if (current_symbol == ';')
+        {
+            m_Tokens.Push(ETokenType::Semicolon, source_line.substr(symbol_index, 1), line_number);
         }
 
         i++;
     }
 
-    for (const Token& token : line_tokens)
+    if (m_bTraceTokens)
     {
-        std::cout << "Typ: " << token.type << ", Wert: " << token.value << "\n";
+        TraceTokens(line_token_begin);
     }
-    std::cout << "\n";
 
-    if (line_tokens.size() > 0)
-    {
-        m_Tokens.push_back(line_tokens);
-    }
+    m_Tokens.EndLine();
 }
 
-bool Tokenizer::IsOperator(const std::string& string_to_check) const
+void Tokenizer::TraceTokens(const size_t first_token_index)
 {
-    const uint32 length = string_to_check.length();
-    for (const std::string arhioperator : operators)
+    for (size_t token_index = first_token_index; token_index < m_Tokens.GetTokenCount(); token_index++)
     {
-        if (arhioperator == string_to_check)
-        {
-            return true;
-        }
+        m_TraceBuffer.append("Typ: ").append(TokenTypeName(m_Tokens.GetType(token_index)));
+        m_TraceBuffer.append(", Wert: ").append(m_Tokens.GetValue(token_index)).append("\n");
     }
+    m_TraceBuffer.append("\n");
 
-    return false;
+    if (m_pTokenTrace && m_TraceBuffer.size() >= TRACE_BUFFER_FLUSH_SIZE) FlushTokenTrace();
 }
 
-bool Tokenizer::IsBooleanOperator(const std::string& string_to_check) const
+void Tokenizer::FlushTokenTrace()
 {
-    const uint32 length = string_to_check.length();
-    for (const std::string arhioperator : boolean_operators)
-    {
-        if (arhioperator == string_to_check)
-        {
-            return true;
-        }
-    }
+    if (!m_pTokenTrace || m_TraceBuffer.empty()) return;
+
+    m_pTokenTrace->write(m_TraceBuffer.data(), m_TraceBuffer.size());
+    m_TraceBuffer.clear();
+}
 
-    return false;
+bool Tokenizer::IsOperator(std::string_view string_to_check) const
+{
+    return arhi::gOperatorTable.Find(string_to_check) != ETokenType::Unkown;
+}
+
+bool Tokenizer::IsBooleanOperator(std::string_view string_to_check) const
+{
+    return arhi::gBooleanOperatorTable.Find(string_to_check) != ETokenType::Unkown;
 }
@@ -3,72 +3,82 @@
 #include "Types.h"
 #include <iostream>
 #include <functional>
+#include <string>
+#include <string_view>
 #include <vector>
-
-struct Token;
-enum class ETokenType : uint8;
+#include "TokenStream.h"
 
 class Tokenizer
 {
 public:
 	Tokenizer() = delete;
-	explicit Tokenizer(const std::string& source_code, std::function<void(const std::vector<std::vector<Token>>&)> callback)
-		: m_SourceCode(source_code), m_OnCompletionEvent(callback)
+	explicit Tokenizer(std::string_view source_code)
+		: m_SourceCode(source_code), m_Tokens(source_code)
+	{
+	}
+	explicit Tokenizer(std::string_view source_code, std::function<void(const TokenStream&)> callback)
+		: m_SourceCode(source_code), m_Tokens(source_code), m_OnCompletionEvent(callback)
 	{
 	}
 	~Tokenizer() = default;
 
+	// Tokenizes the whole source at once and hands the complete stream to the completion callback
 	void Tokenize();
 
-private:
-	void TokenizeSingleLine(const std::string& source_line, const uint32 line_number);
-	bool IsOperator(const std::string& string_to_check) const;
-	bool IsBooleanOperator(const std::string& string_to_check) const;
+	// Pull interface: tokenizes source lines until one of them produces tokens and copies that token
+	// line into 'line_tokens'. Only the current line is kept, so memory stays bounded by the longest
+	// line instead of growing with the file. Returns false once the source is exhausted.
+	bool NextLine(std::vector<Token>& line_tokens);
+
+	// Splits the source at line boundaries and lexes the chunks on 'thread_count' worker threads. The only
+	// state crossing lines is whether a block comment is open, so every chunk is lexed speculatively for
+	// both start states and the matching variant is picked while stitching. The result is identical to
+	// Tokenize(); sources smaller than two chunks are tokenized serially.
+	void TokenizeParallel(const uint32 thread_count, const size_t min_chunk_size = 256 * 1024);
+
+	// Writes every token to the given stream while tokenizing. Off by default, the trace is batched
+	// in memory and flushed in large blocks, so the stream has to stay alive until tokenizing finishes.
+	void EnableTokenTrace(std::ostream& trace_stream);
+
+	const TokenStream& GetTokens() const { return m_Tokens; }
+	// Every Name token is interned here while tokenizing, the compiler resolves names through the same table
+	SymbolTable& GetSymbols() { return m_Symbols; }
 
 private:
-	std::string m_SourceCode = {};
-	std::vector<std::vector<Token>> m_Tokens = {};
+	struct ChunkResult;
 
-	bool m_bIsInComment = false;
+	// Lexer for one chunk of a parallel run, its token offsets stay relative to the whole source code
+	explicit Tokenizer(std::string_view chunk, std::string_view source_code, bool bStartsInComment, bool bTraceTokens)
+		: m_SourceCode(chunk), m_Tokens(source_code), m_bIsInComment(bStartsInComment), m_bInternSymbols(false), m_bTraceTokens(bTraceTokens)
+	{
+	}
+
+	static void LexChunk(std::string_view chunk, std::string_view source_code, bool bTraceTokens, ChunkResult& result);
+
+	bool TokenizeNextSourceLine();
+	void TokenizeSingleLine(std::string_view source_line, const uint32 line_number);
+	void TraceTokens(const size_t first_token_index);
+	void FlushTokenTrace();
+	bool IsOperator(std::string_view string_to_check) const;
+	bool IsBooleanOperator(std::string_view string_to_check) const;
 
 private:
-	std::function<void(const std::vector<std::vector<Token>>&)> m_OnCompletionEvent;
-};
+	// Points into the caller's source buffer (usually a mapped file), which has to outlive the tokens
+	std::string_view m_SourceCode = {};
+	TokenStream m_Tokens = {};
+	SymbolTable m_Symbols = {};
 
-enum class ETokenType : uint8
-{
-	Variable = 0,
-	Name = 1,
-	Numeric = 2,
-	Keyword = 3,
-	Macro = 4,
-	Operator = 5,
-	BooleanOperator = 6,
-	Comment = 7,
-	Semicolon = 8,
-	Assignment = 9,
-	Referral = 10,
-	Parenthesis = 11,
-	Scope = 12,
-	IndexOperator = 13,
-	Unkown = 14
-};
+	size_t m_NextLineBegin = 0;
+	uint32 m_NextLineNumber = 1;
 
-struct Token
-{
-	ETokenType type = ETokenType::Unkown;
-	std::string value = "";
-	uint32 line = 0;
+	bool m_bIsInComment = false;
+	// Chunk lexers leave the symbols empty, the parallel run interns them in source order while stitching
+	bool m_bInternSymbols = true;
 
-	bool empty() const 
-	{
-		return value == "" && line == 0 && type == ETokenType::Unkown;
-	}
+	bool m_bTraceTokens = false;
+	std::ostream* m_pTokenTrace = nullptr;
+	std::string m_TraceBuffer = {};
 
-	Token() = default;
-	Token(ETokenType token, const std::string& value, uint32 line)
-		: type(token), value(value), line(line)
-	{
-	}
-	~Token() = default;
+private:
+	std::function<void(const TokenStream&)> m_OnCompletionEvent;
 };
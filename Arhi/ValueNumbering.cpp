@@ -0,0 +1,536 @@
+#include "ValueNumbering.h"
+#include "Liveness.h"
+#include <cstdint>
+#include <tuple>
+#include <utility>
+
+namespace
+{
+    // Expressions remembered at once. The table starts over when it is full: a forgotten expression only gets a
+    // new number, and values from far back are rarely computed again, while a huge table misses the cache.
+    constexpr size_t EXPRESSION_TABLE_LIMIT = 4096;
+
+    uint64 GetSizeMask(const uint8 size)
+    {
+        return size >= 8 ? UINT64_MAX : (uint64(1) << (size * 8)) - 1;
+    }
+
+    bool IsCommutative(const EOpcode opcode)
+    {
+        return opcode == EOpcode::Add || opcode == EOpcode::Imul || opcode == EOpcode::And;
+    }
+}
+
+bool ValueNumbering::Expression::operator==(const Expression& other) const
+{
+    return std::tie(opcode, size, first, second, scale, value) == std::tie(other.opcode, other.size, other.first, other.second, other.scale, other.value);
+}
+
+size_t ValueNumbering::ExpressionHash::operator()(const Expression& expression) const
+{
+    uint64 hash = static_cast<uint64>(expression.opcode) | static_cast<uint64>(expression.size) << 8 | static_cast<uint64>(expression.scale) << 16;
+    for (const uint64 part : { static_cast<uint64>(expression.first), static_cast<uint64>(expression.second), static_cast<uint64>(expression.value) })
+    {
+        hash = (hash ^ part) * 0x100000001B3ull;
+        hash ^= hash >> 29;
+    }
+
+    return static_cast<size_t>(hash);
+}
+
+void ValueNumbering::Run(MachineProgram& program)
+{
+    m_ReplacedInstructionCount = 0;
+    m_RemovedInstructionCount = 0;
+    m_FoldedBranchCount = 0;
+
+    for (MachineFunction& function : program.GetFunctions())
+    {
+        std::vector<BasicBlock>& blocks = function.blocks;
+        m_EnteredByBranch.assign(blocks.size(), false);
+        for (const BasicBlock& block : blocks)
+        {
+            for (const Instruction& instruction : block.instructions)
+            {
+                if (instruction.IsBranch() && instruction.destination.type == EOperandType::Label) m_EnteredByBranch[static_cast<size_t>(instruction.destination.value)] = true;
+            }
+        }
+
+        for (size_t block_index = 0; block_index < blocks.size(); block_index++)
+        {
+            // The numbers of the block above only hold when nothing else leads here
+            const bool bFallsThrough = block_index > 0
+                && (blocks[block_index - 1].instructions.empty() || !blocks[block_index - 1].instructions.back().IsTerminator());
+            if (!bFallsThrough || m_EnteredByBranch[block_index]) Reset(function);
+
+            NumberBlock(blocks[block_index]);
+        }
+
+        const std::vector<RegisterMask> live_out = arhi::ComputeLiveOutRegisters(function);
+        for (size_t block_index = 0; block_index < blocks.size(); block_index++) RemoveDeadDefinitions(blocks[block_index], live_out[block_index]);
+    }
+}
+
+void ValueNumbering::Reset(const MachineFunction& function)
+{
+    for (Value& value : m_Registers) value = Value();
+    m_Slots.assign(function.stack_slot_sizes.size(), Value());
+    m_Expressions.clear();
+
+    // Number 0 stands for no value
+    m_Constant.assign(1, false);
+    m_Constants.assign(1, 0);
+    m_bFlagsKnown = false;
+}
+
+void ValueNumbering::NumberBlock(BasicBlock& block)
+{
+    std::vector<Instruction>& instructions = block.instructions;
+    m_Dead.assign(instructions.size(), false);
+    for (size_t index = 0; index < instructions.size(); index++)
+    {
+        m_Dead[index] = !NumberInstruction(instructions, index);
+    }
+    arhi::EraseMarked(instructions, m_Dead);
+}
+
+bool ValueNumbering::NumberInstruction(std::vector<Instruction>& instructions, const size_t index)
+{
+    Instruction& instruction = instructions[index];
+    bool bTaken = false;
+
+    switch (instruction.opcode)
+    {
+    case EOpcode::Cmp:
+        m_FlagsFirst = ReadOperand(instruction.destination, instruction.destination.size);
+        m_FlagsSecond = ReadOperand(instruction.source, instruction.destination.size);
+        m_bFlagsKnown = true;
+        return true;
+    case EOpcode::Jcc:
+        if (!EvaluateCondition(instruction.condition, bTaken)) return true;
+
+        m_FoldedBranchCount++;
+        if (bTaken)
+        {
+            instruction = Instruction(EOpcode::Jmp, instruction.destination);
+            return true;
+        }
+        return false;
+    case EOpcode::Setcc:
+        if (EvaluateCondition(instruction.condition, bTaken))
+        {
+            instruction = Instruction(EOpcode::Mov, instruction.destination.WithSize(instruction.destination.size, instruction.destination.IsMemory()), Operand::Immediate(bTaken ? 1 : 0));
+            m_ReplacedInstructionCount++;
+        }
+        break;
+    case EOpcode::Cmovcc:
+        // A 32 bit cmov clears the upper half of the register even when it does not move, unless a 32 bit write did already
+        if (EvaluateCondition(instruction.condition, bTaken)
+            && (bTaken || instruction.destination.size != 4 || m_Registers[static_cast<size_t>(instruction.destination.reg)].size == 4))
+        {
+            if (!bTaken)
+            {
+                m_RemovedInstructionCount++;
+                return false;
+            }
+            instruction = Instruction(EOpcode::Mov, instruction.destination, instruction.source);
+            m_ReplacedInstructionCount++;
+        }
+        break;
+    default:
+        break;
+    }
+
+    const uint32 number = ComputeValue(instruction);
+    if (instruction.WritesFlags()) m_bFlagsKnown = false;
+    if (number == 0)
+    {
+        Forget(instruction);
+        return true;
+    }
+
+    const Operand& destination = instruction.destination;
+    const Value value = { number, destination.size };
+    const bool bRewritable = instruction.IsPure() && !(instruction.WritesFlags() && arhi::AreFlagsReadBeforeWrite(instructions, index + 1));
+
+    // Writes of what the register or slot holds already
+    const bool bRedundant = (bRewritable && destination.IsRegister() && IsSameValue(m_Registers[static_cast<size_t>(destination.reg)], value))
+        || (instruction.opcode == EOpcode::Mov && destination.IsStackSlot() && IsSameValue(m_Slots[static_cast<size_t>(destination.value)], value));
+    if (bRedundant)
+    {
+        m_RemovedInstructionCount++;
+        return false;
+    }
+
+    if (bRewritable && destination.IsRegister())
+    {
+        if (m_Constant[number])
+        {
+            if (instruction.opcode != EOpcode::Mov || !instruction.source.IsImmediate())
+            {
+                instruction = Instruction(EOpcode::Mov, destination, Operand::Immediate(m_Constants[number]));
+                m_ReplacedInstructionCount++;
+            }
+        }
+        else if (instruction.opcode != EOpcode::Mov || !instruction.source.IsRegister())
+        {
+            // A register that holds the result already turns the computation or load into a copy
+            for (uint32 reg = 0; reg < REGISTER_COUNT; reg++)
+            {
+                if (!IsSameValue(m_Registers[reg], value) || (GetRegisterBit(static_cast<ERegister>(reg)) & FRAME_REGISTERS)) continue;
+
+                instruction = Instruction(EOpcode::Mov, destination, Operand::Register(static_cast<ERegister>(reg), destination.size));
+                m_ReplacedInstructionCount++;
+                break;
+            }
+        }
+    }
+
+    WriteDestination(instruction, number);
+    return true;
+}
+
+bool ValueNumbering::EvaluateCondition(const ECondition condition, bool& bTaken) const
+{
+    if (!m_bFlagsKnown) return false;
+
+    // Equal numbers compare equal even when their value is unknown
+    int64 first = 0;
+    int64 second = 0;
+    if (m_FlagsFirst != m_FlagsSecond)
+    {
+        if (!m_Constant[m_FlagsFirst] || !m_Constant[m_FlagsSecond]) return false;
+        first = m_Constants[m_FlagsFirst];
+        second = m_Constants[m_FlagsSecond];
+    }
+
+    switch (condition)
+    {
+    case ECondition::Equal: bTaken = first == second; return true;
+    case ECondition::NotEqual: bTaken = first != second; return true;
+    case ECondition::Greater: bTaken = first > second; return true;
+    case ECondition::GreaterEqual: bTaken = first >= second; return true;
+    case ECondition::Less: bTaken = first < second; return true;
+    case ECondition::LessEqual: bTaken = first <= second; return true;
+    default: return false;
+    }
+}
+
+uint32 ValueNumbering::CreateValue()
+{
+    m_Constant.push_back(false);
+    m_Constants.push_back(0);
+
+    return static_cast<uint32>(m_Constant.size() - 1);
+}
+
+uint32 ValueNumbering::GetConstant(const int64 value, const uint8 size)
+{
+    Expression expression = {};
+    expression.size = size;
+    expression.value = arhi::TruncateToSize(value, size);
+
+    const auto existing = m_Expressions.find(expression);
+    if (existing != m_Expressions.end()) return existing->second;
+
+    const uint32 number = CreateValue();
+    m_Constant[number] = true;
+    m_Constants[number] = expression.value;
+    Remember(expression, number);
+
+    return number;
+}
+
+uint32 ValueNumbering::GetExpression(const Expression& expression)
+{
+    const auto existing = m_Expressions.find(expression);
+    if (existing != m_Expressions.end()) return existing->second;
+
+    const uint32 number = CreateValue();
+    Remember(expression, number);
+
+    return number;
+}
+
+void ValueNumbering::Remember(const Expression& expression, const uint32 number)
+{
+    if (m_Expressions.size() >= EXPRESSION_TABLE_LIMIT) m_Expressions.clear();
+    m_Expressions.emplace(expression, number);
+}
+
+bool ValueNumbering::IsSameValue(const Value& first, const Value& second) const
+{
+    if (first.size != second.size || first.empty()) return false;
+
+    // A constant may have been numbered again after the table started over
+    return first.number == second.number || (m_Constant[first.number] && m_Constant[second.number] && m_Constants[first.number] == m_Constants[second.number]);
+}
+
+uint32 ValueNumbering::Resize(const Value& value, const uint8 size)
+{
+    if (value.size == size) return value.number;
+    // Writes of 1 and 2 bytes keep the upper bytes of whatever was there before
+    if (size > value.size && value.size < 4) return CreateValue();
+
+    if (m_Constant[value.number])
+    {
+        const int64 constant = m_Constants[value.number];
+        return GetConstant(size > value.size ? static_cast<int64>(static_cast<uint64>(constant) & GetSizeMask(value.size)) : constant, size);
+    }
+
+    Expression expression = {};
+    expression.size = size;
+    expression.first = value.number;
+    expression.scale = value.size;
+    return GetExpression(expression);
+}
+
+uint32 ValueNumbering::ReadRegister(const ERegister reg, const uint8 size)
+{
+    Value& value = m_Registers[static_cast<size_t>(reg)];
+    if (value.empty()) value = { CreateValue(), 8 };
+
+    return Resize(value, size);
+}
+
+uint32 ValueNumbering::ReadOperand(const Operand& operand, const uint8 size)
+{
+    switch (operand.type)
+    {
+    case EOperandType::Register:
+        return ReadRegister(operand.reg, operand.size);
+    case EOperandType::Immediate:
+        return GetConstant(operand.value, size);
+    case EOperandType::StackSlot:
+    {
+        // Memory keeps the bytes a narrower store did not reach, only smaller reads are known
+        Value& slot = m_Slots[static_cast<size_t>(operand.value)];
+        if (slot.empty()) slot = { CreateValue(), operand.size };
+        return slot.size >= operand.size ? Resize(slot, operand.size) : CreateValue();
+    }
+    default:
+        return CreateValue();
+    }
+}
+
+uint32 ValueNumbering::ComputeValue(const Instruction& instruction)
+{
+    const Operand& destination = instruction.destination;
+    const Operand& source = instruction.source;
+    if (!destination.IsRegister() && !destination.IsStackSlot()) return 0;
+
+    Expression expression = {};
+    expression.opcode = instruction.opcode;
+    expression.size = destination.size;
+
+    switch (instruction.opcode)
+    {
+    case EOpcode::Mov:
+        return ReadOperand(source, destination.size);
+    case EOpcode::Movzx:
+    case EOpcode::Movsx:
+    case EOpcode::Movsxd:
+        expression.opcode = instruction.opcode == EOpcode::Movzx ? EOpcode::Movzx : EOpcode::Movsx;
+        expression.first = ReadOperand(source, source.size);
+        expression.scale = source.size;
+        break;
+    case EOpcode::Lea:
+        return ComputeAddress(source, destination.size);
+    case EOpcode::Add:
+    case EOpcode::Sub:
+    case EOpcode::Imul:
+    case EOpcode::And:
+    case EOpcode::Shl:
+    case EOpcode::Shr:
+    case EOpcode::Sar:
+    {
+        const uint32 first = ReadOperand(destination, destination.size);
+        const uint32 second = ReadOperand(source, source.IsImmediate() ? destination.size : source.size);
+
+        // The forms the peephole optimizer turns into lea are numbered as adds and multiplications
+        const uint8 bit_count = static_cast<uint8>(destination.size * 8);
+        if (instruction.opcode == EOpcode::Sub && m_Constant[second])
+        {
+            return Combine(EOpcode::Add, destination.size, first, GetConstant(0 - m_Constants[second], destination.size));
+        }
+        if (instruction.opcode == EOpcode::Shl && m_Constant[second] && m_Constants[second] >= 0 && m_Constants[second] < bit_count)
+        {
+            return Combine(EOpcode::Imul, destination.size, first, GetConstant(int64(uint64(1) << m_Constants[second]), destination.size));
+        }
+        return Combine(instruction.opcode, destination.size, first, second);
+    }
+    case EOpcode::Inc:
+    case EOpcode::Dec:
+    case EOpcode::Neg:
+        expression.first = ReadOperand(destination, destination.size);
+        break;
+    default:
+        return 0;
+    }
+
+    int64 constant = 0;
+    if (FoldConstant(expression, constant)) return GetConstant(constant, destination.size);
+
+    const uint32 simplified = Simplify(expression);
+    return simplified != 0 ? simplified : GetExpression(expression);
+}
+
+uint32 ValueNumbering::Combine(const EOpcode opcode, const uint8 size, uint32 first, uint32 second)
+{
+    // x + x is the lea [x+x] of x * 2
+    if (opcode == EOpcode::Add && first == second) return Combine(EOpcode::Imul, size, first, GetConstant(2, size));
+
+    if (IsCommutative(opcode) && second < first) std::swap(first, second);
+    Expression expression = {};
+    expression.opcode = opcode;
+    expression.size = size;
+    expression.first = first;
+    expression.second = second;
+
+    int64 constant = 0;
+    if (FoldConstant(expression, constant)) return GetConstant(constant, size);
+
+    const uint32 simplified = Simplify(expression);
+    return simplified != 0 ? simplified : GetExpression(expression);
+}
+
+uint32 ValueNumbering::ComputeAddress(const Operand& address, const uint8 size)
+{
+    // The low bytes of the 64 bit address only depend on the low bytes of base and index
+    const uint8 read_size = size <= 4 ? size : 8;
+    const uint32 base = address.reg != ERegister::None ? ReadRegister(address.reg, read_size) : 0;
+    const uint32 index = address.index != ERegister::None ? ReadRegister(address.index, read_size) : 0;
+
+    uint32 number = base;
+    if (index != 0)
+    {
+        // [x+x*s] is x * (s + 1)
+        if (index == base) number = Combine(EOpcode::Imul, size, base, GetConstant(address.scale + 1, size));
+        else
+        {
+            const uint32 scaled = address.scale > 1 ? Combine(EOpcode::Imul, size, index, GetConstant(address.scale, size)) : index;
+            number = base != 0 ? Combine(EOpcode::Add, size, base, scaled) : scaled;
+        }
+    }
+
+    if (address.value != 0 || number == 0)
+    {
+        const uint32 displacement = GetConstant(address.value, size);
+        number = number != 0 ? Combine(EOpcode::Add, size, number, displacement) : displacement;
+    }
+    return number;
+}
+
+uint32 ValueNumbering::Simplify(const Expression& expression)
+{
+    const EOpcode opcode = expression.opcode;
+    if (expression.first == expression.second)
+    {
+        if (opcode == EOpcode::Sub) return GetConstant(0, expression.size);
+        if (opcode == EOpcode::And) return expression.first;
+    }
+
+    // Commutative operations may have sorted the constant in front
+    for (const bool bSwapped : { false, true })
+    {
+        const uint32 variable = bSwapped ? expression.second : expression.first;
+        const uint32 operand = bSwapped ? expression.first : expression.second;
+        if (operand == 0 || !m_Constant[operand] || (bSwapped && !IsCommutative(opcode))) continue;
+
+        const int64 constant = m_Constants[operand];
+        const bool bShift = opcode == EOpcode::Shl || opcode == EOpcode::Shr || opcode == EOpcode::Sar;
+        if (constant == 0 && (opcode == EOpcode::Add || opcode == EOpcode::Sub || bShift)) return variable;
+        if (constant == 1 && opcode == EOpcode::Imul) return variable;
+        if (constant == 0 && (opcode == EOpcode::Imul || opcode == EOpcode::And)) return GetConstant(0, expression.size);
+    }
+
+    return 0;
+}
+
+bool ValueNumbering::FoldConstant(const Expression& expression, int64& result) const
+{
+    // Missing operands count as 0, like the second one of inc or neg
+    if ((expression.first != 0 && !m_Constant[expression.first]) || (expression.second != 0 && !m_Constant[expression.second])) return false;
+
+    const uint64 first = static_cast<uint64>(m_Constants[expression.first]);
+    const uint64 second = static_cast<uint64>(m_Constants[expression.second]);
+    const uint64 shift_count = second & (expression.size == 8 ? 63 : 31);
+
+    uint64 value = 0;
+    switch (expression.opcode)
+    {
+    case EOpcode::Add: value = first + second; break;
+    case EOpcode::Sub: value = first - second; break;
+    case EOpcode::Imul: value = first * second; break;
+    case EOpcode::And: value = first & second; break;
+    case EOpcode::Shl: value = first << shift_count; break;
+    case EOpcode::Shr: value = (first & GetSizeMask(expression.size)) >> shift_count; break;
+    case EOpcode::Sar: value = static_cast<uint64>(static_cast<int64>(first) >> shift_count); break;
+    case EOpcode::Inc: value = first + 1; break;
+    case EOpcode::Dec: value = first - 1; break;
+    case EOpcode::Neg: value = 0 - first; break;
+    // Constants are kept sign extended from their size
+    case EOpcode::Movzx: value = first & GetSizeMask(expression.scale); break;
+    case EOpcode::Movsx: value = first; break;
+    default: return false;
+    }
+
+    result = static_cast<int64>(value);
+    return true;
+}
+
+void ValueNumbering::WriteDestination(const Instruction& instruction, const uint32 number)
+{
+    Forget(instruction);
+
+    const Operand& destination = instruction.destination;
+    if (destination.IsRegister()) m_Registers[static_cast<size_t>(destination.reg)] = { number, destination.size };
+    else if (destination.IsStackSlot()) m_Slots[static_cast<size_t>(destination.value)] = { number, destination.size };
+}
+
+void ValueNumbering::Forget(const Instruction& instruction)
+{
+    const RegisterMask defined = instruction.GetDefinedRegisters();
+    for (uint32 reg = 0; reg < REGISTER_COUNT; reg++)
+    {
+        if (defined & (1u << reg)) m_Registers[reg] = Value();
+    }
+
+    // Nothing takes the address of a slot, but a call is not worth the risk
+    if (instruction.opcode == EOpcode::Call || instruction.opcode == EOpcode::Syscall)
+    {
+        m_Slots.assign(m_Slots.size(), Value());
+        return;
+    }
+
+    if (!instruction.WritesMemory()) return;
+    for (const Operand* operand : { &instruction.destination, &instruction.source })
+    {
+        if (operand->IsStackSlot()) m_Slots[static_cast<size_t>(operand->value)] = Value();
+        else if (operand->IsMemory()) m_Slots.assign(m_Slots.size(), Value());
+    }
+}
+
+void ValueNumbering::RemoveDeadDefinitions(BasicBlock& block, const RegisterMask live_out)
+{
+    std::vector<Instruction>& instructions = block.instructions;
+    m_Dead.assign(instructions.size(), false);
+
+    // The flags are never read behind the block
+    RegisterMask live_registers = live_out;
+    bool bFlagsLive = false;
+    for (size_t index = instructions.size(); index > 0; index--)
+    {
+        const Instruction& instruction = instructions[index - 1];
+
+        m_Dead[index - 1] = instruction.IsPure() && (instruction.destination.IsRegister() || instruction.opcode == EOpcode::Cmp)
+            && (instruction.GetDefinedRegisters() & live_registers) == 0 && (!instruction.WritesFlags() || !bFlagsLive);
+        if (m_Dead[index - 1]) continue;
+
+        live_registers = arhi::GetLiveRegistersBefore(instructions, index - 1, live_registers);
+        if (instruction.WritesFlags()) bFlagsLive = false;
+        if (instruction.ReadsFlags()) bFlagsLive = true;
+    }
+
+    m_RemovedInstructionCount += arhi::EraseMarked(instructions, m_Dead);
+}
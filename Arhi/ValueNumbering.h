@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Types.h"
+#include "MachineIR.h"
+#include <unordered_map>
+#include <vector>
+
+// Gives every value a register or stack slot holds a number, so equal numbers mean equal values. Two
+// computations with the same operation on the same numbers produce the same number, which finds a + b
+// computed twice, reads of a copy of a local and the repeated bodies of an unrolled repeat!. An instruction
+// whose result is held by a register already becomes a copy of it or disappears, one whose operands are all
+// constants becomes a mov of the result, and a cmp of two constants decides the jcc, setcc or cmovcc behind
+// it. Numbers carry over into blocks that are only entered by falling through, every other block starts
+// without knowing anything. Afterwards the register writes nothing reads anymore are removed.
+class ValueNumbering
+{
+public:
+	ValueNumbering() = default;
+	~ValueNumbering() = default;
+
+	void Run(MachineProgram& program);
+
+	size_t GetReplacedInstructionCount() const { return m_ReplacedInstructionCount; }
+	size_t GetRemovedInstructionCount() const { return m_RemovedInstructionCount; }
+	size_t GetFoldedBranchCount() const { return m_FoldedBranchCount; }
+
+private:
+	// A value number and the size it was written with, the rest of a register is known for 4 and 8 bytes only
+	struct Value
+	{
+		uint32 number = 0;
+		uint8 size = 0;
+
+		bool empty() const { return size == 0; }
+	};
+
+	// An operation on value numbers. Constants have no operands and keep their value in 'value'.
+	struct Expression
+	{
+		EOpcode opcode = EOpcode::Mov;
+		uint8 size = 0;
+		uint32 first = 0;
+		uint32 second = 0;
+		uint8 scale = 0;
+		int64 value = 0;
+
+		bool operator==(const Expression& other) const;
+	};
+
+	struct ExpressionHash
+	{
+		size_t operator()(const Expression& expression) const;
+	};
+
+	void Reset(const MachineFunction& function);
+	void NumberBlock(BasicBlock& block);
+	// Returns false when the instruction is to be removed
+	bool NumberInstruction(std::vector<Instruction>& instructions, const size_t index);
+	// Decides the condition from the last cmp, returns false when its operands are not both constant
+	bool EvaluateCondition(const ECondition condition, bool& bTaken) const;
+
+	uint32 CreateValue();
+	uint32 GetConstant(const int64 value, const uint8 size);
+	uint32 GetExpression(const Expression& expression);
+	void Remember(const Expression& expression, const uint32 number);
+	bool IsSameValue(const Value& first, const Value& second) const;
+	// The value viewed with another size: the low bytes, or the zero extension of a 4 byte write
+	uint32 Resize(const Value& value, const uint8 size);
+	uint32 ReadOperand(const Operand& operand, const uint8 size);
+	uint32 ReadRegister(const ERegister reg, const uint8 size);
+	// Value of a computing instruction, 0 for anything that is not one
+	uint32 ComputeValue(const Instruction& instruction);
+	// Folded, simplified or looked up value of a binary operation
+	uint32 Combine(const EOpcode opcode, const uint8 size, uint32 first, uint32 second);
+	// Value of a lea, numbered like the adds and multiplication it computes
+	uint32 ComputeAddress(const Operand& address, const uint8 size);
+	bool FoldConstant(const Expression& expression, int64& result) const;
+	// Result of x - x, x + 0, x * 1, x * 0 and the like, 0 when no rule applies
+	uint32 Simplify(const Expression& expression);
+	void WriteDestination(const Instruction& instruction, const uint32 number);
+	void Forget(const Instruction& instruction);
+
+	// Removes the pure instructions whose registers and flags are overwritten before anything reads them, live_out
+	// holds the registers read behind the block
+	void RemoveDeadDefinitions(BasicBlock& block, const RegisterMask live_out);
+
+private:
+	Value m_Registers[REGISTER_COUNT] = {};
+	std::vector<Value> m_Slots = {};
+	std::unordered_map<Expression, uint32, ExpressionHash> m_Expressions = {};
+	std::vector<bool> m_Constant = {};
+	std::vector<int64> m_Constants = {};
+	// Blocks some branch jumps to, they may be entered with other values than the block above leaves
+	std::vector<bool> m_EnteredByBranch = {};
+	// Instructions of the block NumberBlock or RemoveDeadDefinitions leaves out
+	std::vector<bool> m_Dead = {};
+
+	// Operands of the cmp the flags come from
+	bool m_bFlagsKnown = false;
+	uint32 m_FlagsFirst = 0;
+	uint32 m_FlagsSecond = 0;
+
+	size_t m_ReplacedInstructionCount = 0;
+	size_t m_RemovedInstructionCount = 0;
+	size_t m_FoldedBranchCount = 0;
+};